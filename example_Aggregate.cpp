@@ -0,0 +1,74 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+struct DefaultSort: DefaultValue<std::string>
+{
+  static std::string get_default_value() { return "name"; }
+};
+
+struct SearchQuery
+{
+  std::string           q;
+  int                   page = 1;
+  int                   size = 20;
+  std::string           sort;
+  std::vector<unsigned> ids;
+  double                minPrice = 0;
+
+  using fields = std::tuple<Field<"q", &SearchQuery::q, Require>, Field<"page", &SearchQuery::page>,
+                            Field<"size", &SearchQuery::size>, Field<"sort", &SearchQuery::sort, DefaultSort>,
+                            Field<"ids", &SearchQuery::ids, MaxCount<100>>, Field<"min_price", &SearchQuery::minPrice>>;
+};
+
+struct SignupForm
+{
+  std::string name;
+  std::string email;
+  int         age = 0;
+
+  using fields = std::tuple<Field<"name", &SignupForm::name, Require>, Field<"email", &SignupForm::email, Require>,
+                            Field<"age", &SignupForm::age>>;
+};
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful("/search",
+                       [](Ctx& ctx, UrlParams<SearchQuery, Require> query) -> Ret
+                       {
+                         cout << "q: " << query->q << " page: " << query->page << " size: " << query->size
+                              << " sort: " << query->sort << " ids: " << query->ids.size()
+                              << " min_price: " << query->minPrice << endl;
+                         return {};
+                       });
+
+  apis.RegisterRestful("/signup",
+                       [](Ctx& ctx, PostParams<SignupForm, Require> form) -> Ret
+                       {
+                         cout << form->name << " <" << form->email << "> " << form->age << endl;
+                         return {.status = 201};
+                       });
+
+  // One scan of the query string binds every field
+  apis.Test("/search?q=phone&page=3&ids=1,2&ids=3&min_price=9.5");
+  /**
+      url: [/search?q=phone&page=3&ids=1,2&ids=3&min_price=9.5] -> [/search]
+      q: phone page: 3 size: 20 sort: name ids: 3 min_price: 9.5
+  */
+
+  cout << apis.Test("/search?page=2").status << endl;
+  /**
+      url: [/search?page=2] -> [/search]
+      Require field: q
+      Require url params
+      400
+  */
+
+  apis.Test("/signup", "name=bob&email=bob@example.com&age=30");
+  /**
+      url: [/signup] -> [/signup]
+      bob <bob@example.com> 30
+  */
+}
@@ -0,0 +1,24 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful(
+      "/user", [](Ctx& ctx, PathParam<int> id) -> Ret { return {.body = "user" + std::to_string(*id)}; },
+      {.parallelSafe = true});
+  apis.RegisterRestful("/add",
+                       [](Ctx& ctx, UrlParam<int, "a", Require> a, PostParam<int, "b", Require> b) -> Ret
+                       { return {.body = std::to_string(*a + *b)}; });
+
+  // One POST carries every sub-request: netstrings of url then body
+  apis.RegisterBatch("/batch", {.maxRequests = 50});
+
+  Ret ret = apis.Test("/batch", "7:/user/1,0:,7:/user/2,0:,8:/add?a=1,3:b=2,7:/add?a=,0:,");
+  cout << ret.status << " " << ret.body << endl;
+  /**
+      200 3:200,5:user1,3:200,5:user2,3:200,1:3,3:400,0:,
+  */
+}
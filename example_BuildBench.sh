@@ -0,0 +1,36 @@
+#!/bin/sh
+# Build benchmark driver for example_BuildBench.cpp: for each route count, compile time, object .text size,
+# dispatch cost and instruction cache misses (perf stat, where available)
+#   ./example_BuildBench.sh [route counts...]        e.g. CXX=clang++ ./example_BuildBench.sh 100 400 800
+set -e
+
+CXX=${CXX:-g++}
+CXXFLAGS=${CXXFLAGS:-"-std=c++20 -O2"}
+DIR=$(cd "$(dirname "$0")" && pwd)
+OUT=$(mktemp -d)
+trap 'rm -rf "$OUT"' EXIT
+
+[ $# -gt 0 ] || set -- 50 100 200 400 800
+
+if command -v perf >/dev/null 2>&1 && perf stat -e L1-icache-load-misses -x, true >/dev/null 2>&1; then
+  PERF=1
+fi
+
+printf '%8s %12s %12s %14s %20s\n' routes compile_s text_bytes ns_per_request L1_icache_misses
+for n in "$@"; do
+  begin=$(date +%s.%N)
+  # shellcheck disable=SC2086
+  $CXX $CXXFLAGS -I"$DIR" -DREST_BENCH_ROUTES="$n" -c "$DIR/example_BuildBench.cpp" -o "$OUT/bench.o"
+  end=$(date +%s.%N)
+  # shellcheck disable=SC2086
+  $CXX $CXXFLAGS "$OUT/bench.o" -o "$OUT/bench" -lpthread
+
+  compile=$(echo "$begin $end" | awk '{ printf "%.1f", $2 - $1 }')
+  text=$(size "$OUT/bench.o" | awk 'NR == 2 { print $1 }')
+  ns=$("$OUT/bench" | sed -n 's/.*: \([0-9.]*\) ns.*/\1/p' | tail -n 1)
+  misses=n/a
+  if [ -n "$PERF" ]; then
+    misses=$(perf stat -x, -e L1-icache-load-misses "$OUT/bench" 2>&1 >/dev/null | awk -F, '/L1-icache-load-misses/ { print $1 }')
+  fi
+  printf '%8s %12s %12s %14s %20s\n' "$n" "$compile" "$text" "${ns:-?}" "$misses"
+done
@@ -0,0 +1,82 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+  apis.RegisterConstant("/health", {.headers = {{"Content-Type", "application/json"}, {"Cache-Control", "no-cache"}},
+                                    .body    = R"({"status":"ok"})"});
+  apis.RegisterRestful("/health-handler",
+                       [](Ctx& ctx) -> Ret
+                       {
+                         return {.headers = {{"Content-Type", "application/json"}, {"Cache-Control", "no-cache"}},
+                                 .body    = R"({"status":"ok"})"};
+                       });
+
+  // The event loop refreshes the Date of every response once per second
+  TimerWheel            wheel;
+  std::function<void()> tick = [&]
+  {
+    HttpDate::Refresh();
+    wheel.Arm(chrono::seconds(1), tick);
+  };
+  tick();
+
+  // The whole response is ready to send()
+  auto ret = apis.Test("/health");
+  cout << *ret.wire << endl;
+  /**
+      url: [/health] -> [/health]
+      HTTP/1.1 200 OK
+      Content-Type: application/json
+      Cache-Control: no-cache
+      ETag: "3bc90453c96be6b5"
+      Date: Sun, 18 Oct 2026 09:30:00 GMT
+      Content-Length: 15
+
+      {"status":"ok"}
+  */
+
+  // Rendered responses keep their headers in the wire only
+  std::string_view wire = *ret.wire;
+  size_t           etag = wire.find("ETag: ") + 6;
+  std::string      ifNoneMatch(wire.substr(etag, wire.find('\r', etag) - etag));
+
+  cout << *apis.Test("/health", "", "If-None-Match: " + ifNoneMatch + "\r\n").wire;
+  /**
+      url: [/health] -> [/health]
+      HTTP/1.1 304 Not Modified
+      Cache-Control: no-cache
+      ETag: "3bc90453c96be6b5"
+      Date: Sun, 18 Oct 2026 09:30:00 GMT
+  */
+
+  // Against a handler whose response is serialized per request
+  constexpr int rounds = 200000;
+  size_t        bytes  = 0;
+  Ctx           ctx("/health", "");
+  auto          begin = chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i)
+    bytes += apis.Handle(ctx).wire->size();
+  auto constant = chrono::steady_clock::now() - begin;
+
+  Ctx handlerCtx("/health-handler", "");
+  begin = chrono::steady_clock::now();
+  for (int i = 0; i < rounds; ++i)
+  {
+    Ret         r = apis.Handle(handlerCtx);
+    std::string out;
+    WriteHead(r, out);
+    out += r.GetBody();
+    bytes -= out.size();
+  }
+  auto handler = chrono::steady_clock::now() - begin;
+
+  auto perCall = [](auto d) { return chrono::duration_cast<chrono::nanoseconds>(d).count() / rounds; };
+  cout << "constant: " << perCall(constant) << " ns, handler + serialize: " << perCall(handler) << " ns" << endl;
+  /**
+      constant: 263 ns, handler + serialize: 1136 ns (single core VM, -O2)
+  */
+}
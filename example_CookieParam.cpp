@@ -0,0 +1,41 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+struct DefaultTheme: DefaultValue<std::string>
+{
+  static std::string get_default_value() { return "light"; }
+};
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful("/profile",
+                       [](Ctx& ctx, CookieParam<std::string_view, "session", Require> session,
+                          CookieParam<std::string, "theme", DefaultTheme> theme, CookieParam<int, "visits"> visits) -> Ret
+                       {
+                         cout << "session: " << session << endl;
+                         cout << "theme: " << theme << endl;
+                         cout << "visits: " << visits << endl;
+                         return {};
+                       });
+
+  // Routes without a CookieParam never tokenize the Cookie header
+  apis.RegisterRestful("/health", [](Ctx& ctx) -> Ret { return {.body = "ok"}; });
+
+  apis.Test("/profile", "", "Cookie: session=\"a1b2c3\"; visits=7\r\n");
+  /**
+      url: [/profile] -> [/profile]
+      session: a1b2c3
+      theme: light
+      visits: 7
+  */
+
+  cout << apis.Test("/profile", "", "Cookie: theme=dark\r\n").status << endl;
+  /**
+      url: [/profile] -> [/profile]
+      Require cookie: session
+      400
+  */
+}
@@ -0,0 +1,98 @@
+#include "restful.hpp"
+
+#include <iomanip>
+#include <sstream>
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful("/events",
+                       [](Ctx& ctx, UrlParam<chrono::sys_seconds, "from", Require>
+                          from, UrlParam<chrono::sys_time<chrono::milliseconds>, "to", Require> to,
+                          UrlParam<chrono::minutes, "window"> window, UrlParam<chrono::year_month_day, "day"> day) -> Ret
+                       {
+                         cout << "span: " << chrono::duration_cast<chrono::milliseconds>(*to - *from).count() << " ms";
+                         if (window)
+                           cout << ", window: " << window->count() << " min";
+                         if (day)
+                           cout << ", day: " << int(day->year()) << "/" << unsigned(day->month()) << "/"
+                                << unsigned(day->day());
+                         cout << endl;
+                         return {};
+                       });
+
+  // An offset is applied, no offset reads as UTC
+  apis.Test("/events?from=2024-03-01T10:00:00Z&to=2024-03-01T07:30:00.250-05:00&window=PT1H30M&day=2024-02-29");
+  /**
+      url: [/events?from=2024-03-01T10:00:00Z&to=2024-03-01T07:30:00.250-05:00&window=PT1H30M&day=2024-02-29] -> [/events]
+      span: 9000250 ms, window: 90 min, day: 2024/2/29
+  */
+
+  apis.Test("/events?from=2024-03-01&to=2024-03-02&window=1h15m");
+  /**
+      url: [/events?from=2024-03-01&to=2024-03-02&window=1h15m] -> [/events]
+      span: 86400000 ms, window: 75 min
+  */
+
+  // Impossible dates fail the param, like durations the unit can not hold ("30s" as minutes)
+  cout << apis.Test("/events?from=2023-02-29T00:00:00&to=2024-03-02").status << endl;
+  /**
+      url: [/events?from=2023-02-29T00:00:00&to=2024-03-02] -> [/events]
+      Require url param: from
+      400
+  */
+
+  // Benchmark against the stdlib approaches
+  std::vector<std::string> stamps;
+  for (int i = 0; i < 1000; ++i)
+  {
+    char buf[32];
+    std::snprintf(buf, sizeof(buf), "2024-%02d-%02dT%02d:%02d:%02dZ", i % 12 + 1, i % 28 + 1, i % 24, i % 60, (i * 7) % 60);
+    stamps.emplace_back(buf);
+  }
+
+  constexpr int rounds = 200;
+  long long     sum    = 0;
+  auto          begin  = chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r)
+    for (auto& s: stamps)
+    {
+      void* ptr = ArgConvertors::base_convertor<chrono::sys_seconds>(s);
+      sum += ((chrono::sys_seconds*)ptr)->time_since_epoch().count();
+      ArgConvertors::clean<chrono::sys_seconds>(ptr);
+    }
+  auto fixed = chrono::steady_clock::now() - begin;
+
+  begin = chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r)
+    for (auto& s: stamps)
+    {
+      std::tm tm{};
+      int     y, mo, d, h, mi, se;
+      std::sscanf(s.c_str(), "%d-%d-%dT%d:%d:%d", &y, &mo, &d, &h, &mi, &se);
+      tm.tm_year = y - 1900, tm.tm_mon = mo - 1, tm.tm_mday = d, tm.tm_hour = h, tm.tm_min = mi, tm.tm_sec = se;
+      sum -= timegm(&tm);
+    }
+  auto scanf = chrono::steady_clock::now() - begin;
+
+  begin = chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r)
+    for (auto& s: stamps)
+    {
+      std::tm            tm{};
+      std::istringstream in(s);
+      in >> std::get_time(&tm, "%Y-%m-%dT%H:%M:%S");
+      sum -= timegm(&tm);
+    }
+  auto getTime = chrono::steady_clock::now() - begin;
+
+  auto perCall = [](auto d) { return chrono::duration_cast<chrono::nanoseconds>(d).count() / (rounds * 1000); };
+  cout << "checksum " << sum << ", fixed layout: " << perCall(fixed) << " ns, sscanf + timegm: " << perCall(scanf)
+       << " ns, get_time + timegm: " << perCall(getTime) << " ns" << endl;
+  /**
+      checksum -343937025492000, fixed layout: 17 ns, sscanf + timegm: 514 ns, get_time + timegm: 1688 ns (single core VM, -O2)
+  */
+}
@@ -0,0 +1,62 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+
+  // ETag is computed from the response body
+  apis.RegisterRestful("/hello",
+                       [](Ctx& ctx) -> Ret
+                       {
+                         cout << "hello handler" << endl;
+                         return {.body = "hello world"};
+                       });
+
+  // The cheap version function is checked first, an unchanged user never executes the handler
+  static std::uint64_t userVersion = 1;
+  apis.RegisterRestful(
+      "/user",
+      [](Ctx& ctx, PathParam<int> id) -> Ret
+      {
+        cout << "user handler: " << id << endl;
+        return {.body = "{\"id\":1}"};
+      },
+      {.version = [](Ctx& ctx) -> ResourceVersion { return {.tag = userVersion, .lastModified = 1679000000}; }});
+
+  Ret ret = apis.Test("/hello");
+  cout << ret.status << " " << ret.headers[0].first << ": " << ret.headers[0].second << endl;
+  /**
+      hello handler
+      200 ETag: "..."
+  */
+
+  ret = apis.Test("/hello", "", "If-None-Match: " + ret.headers[0].second + "\r\n");
+  cout << ret.status << endl;
+  /**
+      hello handler
+      304
+  */
+
+  ret = apis.Test("/user/1", "", "If-None-Match: \"0000000000000001\"\r\n");
+  cout << ret.status << endl;
+  /**
+      304
+  */
+
+  ret = apis.Test("/user/1", "", "If-Modified-Since: Thu, 16 Mar 2023 20:53:20 GMT\r\n");
+  cout << ret.status << endl;
+  /**
+      304
+  */
+
+  userVersion = 2;
+  ret = apis.Test("/user/1", "", "If-None-Match: \"0000000000000001\"\r\n");
+  cout << ret.status << endl;
+  /**
+      user handler: 1
+      200
+  */
+}
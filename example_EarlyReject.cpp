@@ -0,0 +1,66 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful(Method::Put, "/upload",
+                       [](Ctx& ctx, UrlParam<std::string, "name", Require, MaxLength<16>> name,
+                          UrlParam<int, "parts", Range<1, 64>> parts, HeaderParam<std::string, "X-Kind", OneOf<"raw", "zip">> kind,
+                          PostBody<std::string, Require> body) -> Ret
+                       {
+                         cout << "stored " << name << " parts: " << parts << " kind: " << kind << " " << body->size()
+                              << " bytes" << endl;
+                         return {};
+                       });
+
+  // What an I/O loop does once the request line and headers are parsed
+  auto receive = [&](const std::string& url, const std::string& headers, size_t size)
+  {
+    Ctx ctx(url, "", headers);
+    ctx.SetMethod(Method::Put);
+    if (auto rejected = apis.Admit(ctx))
+    {
+      cout << rejected->status << " " << rejected->headers[0].first << ": " << rejected->headers[0].second << endl;
+      return;
+    }
+    if (ctx.ExpectsContinue())
+      cout << "100 Continue" << endl;
+    ctx.SetContentBody(std::string(size, 'x'));
+    cout << apis.Handle(ctx).status << endl;
+  };
+
+  receive("/upload?name=a.bin&parts=4", "Expect: 100-continue\r\nX-Kind: zip\r\n", 1 << 20);
+  /**
+      100 Continue
+      stored a.bin parts: 4 kind: zip 1048576 bytes
+      200
+  */
+
+  // Rejected from the headers alone, the 1 MB body is never read
+  receive("/upload?parts=4", "Expect: 100-continue\r\n", 1 << 20);
+  /**
+      Require url param: name
+      400 Connection: close
+  */
+
+  receive("/upload?name=a.bin&parts=100", "Expect: 100-continue\r\n", 1 << 20);
+  /**
+      Invalid param: parts
+      400 Connection: close
+  */
+
+  receive("/upload?name=a.bin", "Expect: 100-continue\r\nX-Kind: tar\r\n", 1 << 20);
+  /**
+      Invalid param: X-Kind
+      400 Connection: close
+  */
+
+  receive("/upload?name=a-very-long-file-name.bin", "", 1 << 20);
+  /**
+      Invalid param: name
+      400 Connection: close
+  */
+}
@@ -0,0 +1,55 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+enum class Color
+{
+  Red,
+  Green,
+  Blue,
+};
+
+// Declared beside the type, found by ADL
+constexpr std::array<EnumName<Color>, 4> RestfulEnumNames(Color)
+{
+  return {{{"red", Color::Red}, {"green", Color::Green}, {"blue", Color::Blue}, {"azure", Color::Blue}}};
+}
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful("/paint",
+                       [](Ctx& ctx, UrlParam<Color, "color", Require> color, UrlParam<bool, "glossy"> glossy) -> Ret
+                       {
+                         cout << "color: " << int(*color) << ", glossy: " << (glossy ? *glossy : false) << endl;
+                         return {};
+                       });
+
+  apis.Test("/paint?color=green&glossy=yes");
+  /**
+      url: [/paint?color=green&glossy=yes] -> [/paint]
+      color: 1, glossy: 1
+  */
+
+  apis.Test("/paint?color=azure");
+  /**
+      url: [/paint?color=azure] -> [/paint]
+      color: 2, glossy: 0
+  */
+
+  // Unknown names and other spellings fail the param
+  cout << apis.Test("/paint?color=Red").status << endl;
+  /**
+      url: [/paint?color=Red] -> [/paint]
+      Require url param: color
+      400
+  */
+
+  cout << apis.Test("/paint?color=red&glossy=maybe").status << endl;
+  /**
+      url: [/paint?color=red&glossy=maybe] -> [/paint]
+      color: 0, glossy: 0
+      200
+  */
+}
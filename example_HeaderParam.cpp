@@ -0,0 +1,48 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+struct DefaultContentType: DefaultValue<std::string>
+{
+  static std::string get_default_value() { return "text/plain"; }
+};
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful("/upload",
+                       [](Ctx& ctx, HeaderParam<std::string_view, "Authorization", Require> auth,
+                          HeaderParam<std::string, "Content-Type", DefaultContentType> contentType,
+                          HeaderParam<long long, "Content-Length"> length) -> Ret
+                       {
+                         cout << "auth: " << auth << endl;
+                         cout << "type: " << contentType << endl;
+                         cout << "length: " << length << endl;
+                         return {};
+                       });
+
+  // Names match case-insensitively, values are trimmed views into the header block
+  apis.Test("/upload", "hello", "authorization: Bearer abc\r\nCONTENT-LENGTH:   5 \r\n");
+  /**
+      url: [/upload] -> [/upload]
+      auth: Bearer abc
+      type: text/plain
+      length: 5
+  */
+
+  cout << apis.Test("/upload", "", "Content-Type: application/json\r\n").status << endl;
+  /**
+      url: [/upload] -> [/upload]
+      Require header: Authorization
+      400
+  */
+
+  // Headers are indexed once per request, later lookups scan the index only
+  Ctx         ctx("/", "", "Host: example.com\r\nAccept: */*\r\nX-Request-Id: 42\r\n");
+  std::string host(ctx.GetHeader("host"));
+  cout << host << " " << ctx.GetHeader("X-REQUEST-ID") << endl;
+  /**
+      example.com 42
+  */
+}
@@ -0,0 +1,109 @@
+#include "restful.hpp"
+
+#include <sstream>
+
+using namespace std;
+using namespace Restful;
+
+struct Item
+{
+  std::uint64_t id = 0;
+  std::string   name;
+  double        score = 0;
+
+  using fields = std::tuple<Field<"id", &Item::id>, Field<"name", &Item::name>, Field<"score", &Item::score>>;
+};
+
+int main()
+{
+  std::vector<Item> items;
+  for (int i = 0; i < 2000; ++i)
+    items.push_back({std::uint64_t(i), "item \"" + std::to_string(i) + "\" with a longer description\n", i * 0.75});
+
+  Apis apis;
+  apis.RegisterRestful("/items",
+                       [&items](Ctx& ctx, UrlParam<size_t, "limit", Require> limit) -> Ret
+                       {
+                         JsonWriter json;
+                         json.BeginObject().Key("total").Uint(items.size()).Key("items").BeginArray();
+                         for (size_t i = 0; i < std::min(*limit, items.size()); ++i)
+                           json.Value(items[i]);
+                         return json.EndArray().EndObject().Finish();
+                       });
+
+  auto ret = apis.Test("/items?limit=2");
+  ret.ForEachSegment([](std::string_view segment) { cout << segment << endl; });
+  /**
+      url: [/items?limit=2] -> [/items]
+      {"total":2000,"items":[{"id":0,"name":"item \"0\" with a longer description\n","score":0},{"id":1,"name":"item \"1\" with a longer description\n","score":0.75}]}
+  */
+
+  // Large bodies stay in pooled chunks, one iovec each
+  ret = apis.Test("/items?limit=2000");
+  cout << ret.BodySize() << " bytes in " << ret.chunks.size() << " chunks" << endl;
+  /**
+      url: [/items?limit=2000] -> [/items]
+      152322 bytes in 10 chunks
+  */
+
+  // Against the usual ways of building the same body
+  auto escape = [](std::string_view s)
+  {
+    std::string out;
+    for (char c: s)
+    {
+      if (c == '"' || c == '\\')
+        out += '\\', out += c;
+      else if (c == '\n')
+        out += "\\n";
+      else
+        out += c;
+    }
+    return out;
+  };
+
+  constexpr int rounds = 200;
+  size_t        bytes  = 0;
+  auto          begin  = chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r)
+  {
+    JsonWriter json;
+    json.BeginArray();
+    for (auto& item: items)
+      json.Value(item);
+    bytes += json.EndArray().Finish().BodySize();
+  }
+  auto writer = chrono::steady_clock::now() - begin;
+
+  begin = chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r)
+  {
+    std::ostringstream os;
+    os << '[';
+    for (auto& item: items)
+      os << (&item == &items[0] ? "" : ",") << "{\"id\":" << item.id << ",\"name\":\"" << escape(item.name)
+         << "\",\"score\":" << item.score << '}';
+    os << ']';
+    bytes -= os.str().size();
+  }
+  auto stream = chrono::steady_clock::now() - begin;
+
+  begin = chrono::steady_clock::now();
+  for (int r = 0; r < rounds; ++r)
+  {
+    std::string s = "[";
+    for (auto& item: items)
+      s += (&item == &items[0] ? "" : ",") + std::string("{\"id\":") + std::to_string(item.id) + ",\"name\":\"" +
+           escape(item.name) + "\",\"score\":" + std::to_string(item.score) + "}";
+    s += "]";
+    bytes -= s.size();
+  }
+  auto concat = chrono::steady_clock::now() - begin;
+
+  auto perCall = [](auto d) { return chrono::duration_cast<chrono::microseconds>(d).count() / rounds; };
+  cout << "2000 items, JsonWriter: " << perCall(writer) << " us, ostringstream: " << perCall(stream)
+       << " us, string concat: " << perCall(concat) << " us" << endl;
+  /**
+      2000 items, JsonWriter: 629 us, ostringstream: 2329 us, string concat: 2052 us (single core VM, -O2)
+  */
+}
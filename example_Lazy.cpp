@@ -0,0 +1,70 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+struct Document
+{
+  std::string text;
+
+  friend std::ostream& operator<<(std::ostream& os, const Document& o) { return os << o.text.size() << " bytes"; }
+};
+
+namespace Restful::ArgConvertors
+{
+  template<>
+  inline void* base_convertor<Document>(const std::string_view& src)
+  {
+    cout << "parsing document" << endl;
+    return src.empty() ? nullptr : new Document{std::string(src)};
+  }
+
+  template<>
+  inline void clean<Document>(void* ptr)
+  {
+    if (ptr)
+      delete (Document*)ptr;
+  }
+} // namespace Restful::ArgConvertors
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful("/upload",
+                       [](Ctx& ctx, UrlParam<std::string, "token"> token, Lazy<PostBody<Document, Require>> doc) -> Ret
+                       {
+                         // Rejected before the body is copied or parsed
+                         if (!token || *token != "secret")
+                           return {.status = 403};
+
+                         // First access parses the body, later ones reuse it
+                         if (!doc)
+                           return {.status = 400};
+
+                         cout << "stored " << *doc << endl;
+                         cout << "again " << *doc << endl;
+                         return {};
+                       });
+
+  cout << apis.Test("/upload?token=wrong", std::string(1 << 20, 'x')).status << endl;
+  /**
+      url: [/upload?token=wrong] -> [/upload]
+      403
+  */
+
+  apis.Test("/upload?token=secret", std::string(1 << 20, 'x'));
+  /**
+      url: [/upload?token=secret] -> [/upload]
+      parsing document
+      stored 1048576 bytes
+      again 1048576 bytes
+  */
+
+  // Require still answers 400 before the handler runs, from a presence check only
+  cout << apis.Test("/upload?token=secret").status << endl;
+  /**
+      url: [/upload?token=secret] -> [/upload]
+      Require lazy param: 1
+      400
+  */
+}
@@ -0,0 +1,77 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful("/users",
+                       [](Ctx& ctx, UrlParam<std::vector<unsigned>, "ids", Require, MaxCount<500>> ids,
+                          UrlParam<std::vector<std::string>, "tag"> tags) -> Ret
+                       {
+                         cout << "ids:";
+                         for (auto id: *ids)
+                           cout << " " << id;
+                         cout << endl << "tags: " << (tags ? tags->size() : 0) << endl;
+                         return {};
+                       });
+
+  // Comma separated lists and repeated keys are merged in order
+  apis.Test("/users?ids=3,1,4&tag=a&ids=15&tag=b");
+  /**
+      url: [/users?ids=3,1,4&tag=a&ids=15&tag=b] -> [/users]
+      ids: 3 1 4 15
+      tags: 2
+  */
+
+  // Invalid values and more than MaxCount values fail the param
+  cout << apis.Test("/users?ids=1,x").status << endl;
+  /**
+      url: [/users?ids=1,x] -> [/users]
+      Invalid param: ids
+      400
+  */
+
+  // Bulk fetch: 500 ids, each parsed 8 digits at a time with SWAR
+  std::string url = "/users?ids=";
+  for (int i = 0; i < 500; ++i)
+    url += std::to_string(10000000 + i * 7919) + ",";
+
+  Ctx  ctx(url, "");
+  auto begin = chrono::steady_clock::now();
+  for (int i = 0; i < 2000; ++i)
+  {
+    bool  rejected = false;
+    void* ptr      = ArgConvertors::base_list_convertor<unsigned, MaxCount<500>>(
+        [&ctx](auto&& cb) { return ctx.ForEachUrlParam("ids", cb); }, rejected);
+    ArgConvertors::clean<std::vector<unsigned>>(ptr);
+  }
+  auto swar = chrono::steady_clock::now() - begin;
+
+  begin = chrono::steady_clock::now();
+  for (int i = 0; i < 2000; ++i)
+  {
+    std::vector<unsigned> ids;
+    ctx.ForEachUrlParam("ids",
+                        [&ids](std::string_view value)
+                        {
+                          for (size_t pos = 0; pos < value.size();)
+                          {
+                            size_t comma = std::min(value.find(',', pos), value.size());
+                            if (comma > pos)
+                              std::from_chars(value.data() + pos, value.data() + comma, ids.emplace_back());
+                            pos = comma + 1;
+                          }
+                          return true;
+                        });
+  }
+  auto scalar = chrono::steady_clock::now() - begin;
+
+  cout << "500 ids, list parser: " << chrono::duration_cast<chrono::nanoseconds>(swar).count() / 2000
+       << " ns, find + from_chars: " << chrono::duration_cast<chrono::nanoseconds>(scalar).count() / 2000 << " ns"
+       << endl;
+  /**
+      500 ids, list parser: 6933 ns, find + from_chars: 9723 ns (single core VM, -O2)
+  */
+}
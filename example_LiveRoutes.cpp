@@ -0,0 +1,76 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful("/v1/user", [](Ctx& ctx) -> Ret { return {.body = "v1"}; });
+
+  // Roll out v2 while serving: both changes become visible at once
+  apis.Update(
+      [](Apis& apis)
+      {
+        apis.RegisterRestful("/v2/user", [](Ctx& ctx) -> Ret { return {.body = "v2"}; });
+        apis.RegisterRestful<"/tenant/{id:int}">([](Ctx& ctx, PathVar<int, "id"> id) -> Ret
+                                                 { return {.body = "tenant " + std::to_string(*id)}; });
+      });
+  auto v2 = apis.Test("/v2/user"), tenant = apis.Test("/tenant/7");
+  cout << v2.body << ", " << tenant.body << endl;
+  /**
+      url: [/v2/user] -> [/v2/user]
+      url: [/tenant/7] -> [/tenant/{id:int}]
+      v2, tenant 7
+  */
+
+  // Routes are removed the way they were registered
+  apis.Update(
+      [](Apis& apis)
+      {
+        apis.Unregister("/v1/user");
+        apis.Unregister("/tenant/{id:int}");
+      });
+  auto v1 = apis.Test("/v1/user");
+  tenant  = apis.Test("/tenant/7");
+  cout << v1.status << " " << tenant.status << endl;
+  /**
+      Not found: /v1/user
+      Not found: /tenant/7
+      404 404
+  */
+
+  // Requests keep being served, without a lock, while a writer republishes the table
+  constexpr int     rounds = 1000000;
+  std::atomic<bool> updating{true};
+  std::thread       writer(
+      [&apis, &updating]
+      {
+        for (int i = 0; updating.load(std::memory_order_relaxed); ++i)
+        {
+          std::string path = "/plugin/" + std::to_string(i % 64);
+          apis.RegisterRestful(path, [](Ctx& ctx) -> Ret { return {}; });
+          apis.Unregister(path);
+        }
+      });
+
+  auto measure = [&apis]
+  {
+    Ctx  ctx("/v2/user", "");
+    auto begin = chrono::steady_clock::now();
+    for (int i = 0; i < rounds; ++i)
+      if (apis.Handle(ctx).status != 200)
+        std::abort();
+    return chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin).count() / rounds;
+  };
+
+  auto withUpdates = measure();
+  updating = false;
+  writer.join();
+  auto quiet = measure();
+
+  cout << "request: " << quiet << " ns, while updating: " << withUpdates << " ns" << endl;
+  /**
+      request: 574 ns, while updating: 1426 ns (single core VM shared with the writer, -O2)
+  */
+}
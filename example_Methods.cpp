@@ -0,0 +1,70 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+  apis.EnableCors({.allowOrigins = {"https://app.example.com"}, .allowHeaders = {"Content-Type", "X-Token"}});
+
+  apis.RegisterRestful(Method::Get, "/user",
+                       [](Ctx& ctx, UrlParam<int, "id", Require> id) -> Ret { return {.body = "user " + to_string(*id)}; });
+  apis.RegisterRestful(Method::Post, "/user",
+                       [](Ctx& ctx, PostParam<std::string, "name", Require> name) -> Ret
+                       { return {.status = 201, .body = "created " + *name}; });
+  apis.RegisterRestful<"/user/{id:uint}">(Method::Delete,
+                                          [](Ctx& ctx, PathVar<unsigned, "id"> id) -> Ret
+                                          {
+                                            cout << "delete " << id << endl;
+                                            return {.status = 204};
+                                          });
+
+  auto print = [](const Ret& ret)
+  {
+    cout << ret.status;
+    for (auto& [key, value]: ret.headers)
+      cout << " | " << key << ": " << value;
+    cout << " | body: " << ret.GetBody() << endl;
+  };
+
+  print(apis.Test(Method::Get, "/user?id=1"));
+  print(apis.Test(Method::Post, "/user", "name=bob"));
+  print(apis.Test(Method::Delete, "/user/7"));
+  /**
+      url: [/user?id=1] -> [/user]
+      200 | ETag: "7302e95ddeb16388" | body: user 1
+      url: [/user] -> [/user]
+      201 | body: created bob
+      url: [/user/7] -> [/user/{id:uint}]
+      delete 7
+      204 | body:
+  */
+
+  // HEAD runs GET and keeps its headers, the body is replaced by Content-Length
+  print(apis.Test(Method::Head, "/user?id=1"));
+  /**
+      200 | ETag: "7302e95ddeb16388" | Content-Length: 6 | body:
+  */
+
+  // Unregistered method, answered by the router
+  print(apis.Test(Method::Put, "/user"));
+  /**
+      405 | Allow: GET, HEAD, POST, OPTIONS | body:
+  */
+
+  // CORS preflight, no handler is invoked
+  print(apis.Test(Method::Options, "/user", "",
+                  "Origin: https://app.example.com\r\nAccess-Control-Request-Method: POST\r\n"));
+  /**
+      204 | Allow: GET, HEAD, POST, OPTIONS | Access-Control-Allow-Methods: GET, HEAD, POST, OPTIONS
+          | Access-Control-Allow-Headers: Content-Type, X-Token | Access-Control-Max-Age: 600
+          | Access-Control-Allow-Origin: https://app.example.com | Vary: Origin | body:
+  */
+
+  // Cross-origin request from an unknown origin, no CORS headers
+  print(apis.Test(Method::Get, "/user?id=2", "", "Origin: https://evil.example.com\r\n"));
+  /**
+      200 | ETag: "141578126facfda7" | body: user 2
+  */
+}
@@ -0,0 +1,122 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+// Short-circuits with 401, the handler and the later stages are skipped
+struct Auth
+{
+  std::optional<Ret> Before(Ctx& ctx)
+  {
+    if (ctx.GetHeader("Authorization") != "Bearer secret")
+      return Ret{.status = 401, .headers = {{"WWW-Authenticate", "Bearer"}}};
+    return std::nullopt;
+  }
+};
+
+// State lives in the stage, one instance per request on the stack
+struct Timing
+{
+  chrono::steady_clock::time_point begin;
+
+  std::optional<Ret> Before(Ctx& ctx)
+  {
+    begin = chrono::steady_clock::now();
+    return std::nullopt;
+  }
+
+  void After(Ctx& ctx, Ret& ret)
+  {
+    auto us = chrono::duration_cast<chrono::microseconds>(chrono::steady_clock::now() - begin).count();
+    ret.headers.emplace_back("Server-Timing", "app;dur=" + std::to_string(us / 1000.0));
+  }
+};
+
+struct Metrics
+{
+  static inline std::atomic<size_t> requests{0}, errors{0};
+
+  void After(Ctx& ctx, Ret& ret)
+  {
+    requests.fetch_add(1, std::memory_order_relaxed);
+    if (ret.status >= 400)
+      errors.fetch_add(1, std::memory_order_relaxed);
+  }
+};
+
+int main()
+{
+  Apis apis;
+  // Metrics runs first, so it also counts what Auth rejects
+  apis.RegisterRestful<Metrics, Auth, Timing>("/report",
+                                              [](Ctx& ctx, UrlParam<int, "year", Require> year) -> Ret
+                                              { return {.body = "report " + std::to_string(*year)}; });
+  apis.RegisterRestful<"/user/{id:int}", Metrics, Auth>([](Ctx& ctx, PathVar<int, "id"> id) -> Ret
+                                                        { return {.body = "user " + std::to_string(*id)}; });
+
+  auto ret = apis.Test("/report?year=2024", "", "Authorization: Bearer secret\r\n");
+  cout << ret.status << " " << ret.body << ", timed: " << (ret.FindHeader("Server-Timing") != nullptr) << endl;
+  /**
+      url: [/report?year=2024] -> [/report]
+      200 report 2024, timed: 1
+  */
+
+  cout << apis.Test("/user/7").status << endl;
+  /**
+      url: [/user/7] -> [/user/{id:int}]
+      401
+  */
+
+  cout << apis.Test("/report", "", "Authorization: Bearer secret\r\n").status << endl;
+  cout << "requests: " << Metrics::requests << ", errors: " << Metrics::errors << endl;
+  /**
+      url: [/report] -> [/report]
+      Require url param: year
+      400
+      requests: 3, errors: 2
+  */
+
+  // Against the same checks pasted into the handler
+  apis.RegisterRestful<Metrics, Auth, Timing>("/chain", [](Ctx& ctx) -> Ret { return {.body = "ok"}; });
+  apis.RegisterRestful("/pasted",
+                       [](Ctx& ctx) -> Ret
+                       {
+                         Metrics metrics;
+                         Ret     ret = [&ctx]
+                         {
+                           if (auto rejected = Auth().Before(ctx))
+                             return std::move(*rejected);
+                           Timing timing;
+                           timing.Before(ctx);
+                           Ret ret{.body = "ok"};
+                           timing.After(ctx, ret);
+                           return ret;
+                         }();
+                         metrics.After(ctx, ret);
+                         return ret;
+                       });
+
+  constexpr int rounds = 1000000;
+  auto          measure = [&apis](const char* path)
+  {
+    Ctx  ctx(path, "", "Authorization: Bearer secret\r\n");
+    long best = std::numeric_limits<long>::max();
+    for (int round = 0; round < 5; ++round)
+    {
+      auto begin = chrono::steady_clock::now();
+      for (int i = 0; i < rounds; ++i)
+        if (apis.Handle(ctx).status != 200)
+          std::abort();
+      auto elapsed = chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now() - begin).count();
+      best         = std::min<long>(best, elapsed / rounds);
+    }
+    return best;
+  };
+
+  auto pasted = measure("/pasted");
+  auto chain  = measure("/chain");
+  cout << "pasted into the handler: " << pasted << " ns, middleware chain: " << chain << " ns" << endl;
+  /**
+      pasted into the handler: 848 ns, middleware chain: 838 ns (single core VM, -O2)
+  */
+}
@@ -0,0 +1,73 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+  apis.RegisterRestful<"/user/{id:uint}/post/{pid}">(
+      [](Ctx& ctx, PathVar<unsigned, "id", Require> id, PathVar<std::string, "pid"> pid) -> Ret
+      {
+        cout << "user: " << id << " post: " << pid << endl;
+        return {};
+      });
+
+  // Literal segments win over variables, variables are tried uint, int, then str
+  apis.RegisterRestful<"/user/me/post/{pid}">(
+      [](Ctx& ctx, PathVar<std::string, "pid"> pid) -> Ret
+      {
+        cout << "me post: " << pid << endl;
+        return {};
+      });
+
+  apis.RegisterRestful<"/user/{name}">(
+      [](Ctx& ctx, PathVar<std::string, "name"> name, PathParam<std::string> tail) -> Ret
+      {
+        cout << "user name: " << name << " tail: " << tail << endl;
+        return {};
+      });
+
+  apis.RegisterRestful<"/offset/{delta:int}">(
+      [](Ctx& ctx, PathVar<int, "delta"> delta) -> Ret
+      {
+        cout << "delta: " << delta << endl;
+        return {};
+      });
+
+  apis.Test("/user/42/post/hello");
+  /**
+      url: [/user/42/post/hello] -> [/user/{id:uint}/post/{pid}]
+      user: 42 post: hello
+  */
+
+  apis.Test("/user/me/post/7");
+  /**
+      url: [/user/me/post/7] -> [/user/me/post/{pid}]
+      me post: 7
+  */
+
+  // "bob" is not a uint, falls back to {name}, the remaining segments become PathParam
+  apis.Test("/user/bob/post/1");
+  /**
+      url: [/user/bob/post/1] -> [/user/{name}]
+      user name: bob tail: post
+  */
+
+  apis.Test("/offset/-3");
+  /**
+      url: [/offset/-3] -> [/offset/{delta:int}]
+      delta: -3
+  */
+
+  cout << apis.Test("/offset/abc").status << endl;
+  /**
+      Not found: /offset/abc
+      404
+  */
+
+  // Compile errors:
+  //   apis.RegisterRestful<"/user/{id:float}">(...);                        unknown variable type
+  //   apis.RegisterRestful<"/user/{id}">([](Ctx&, PathVar<int, "uid">)...); key is not in the pattern
+  //   apis.RegisterRestful("/user", [](Ctx&, PathVar<int, "id">)...);        PathVar needs a pattern
+}
@@ -0,0 +1,47 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+
+  // 2 requests per second per client, bursts of up to 3
+  apis.RegisterRestful(
+      "/search", [](Ctx& ctx, UrlParam<std::string, "q"> q) -> Ret { return {.body = "result of " + *q}; },
+      {.rateLimit = {.rate = 2, .burst = 3, .key = RateLimitKey::ClientIp}});
+
+  // 1 request per second per api key
+  apis.RegisterRestful(
+      "/export", [](Ctx& ctx) -> Ret { return {}; },
+      {.rateLimit = {.rate = 1, .key = RateLimitKey::Header, .keyName = "X-Api-Key"}});
+
+  for (int i = 0; i < 4; ++i)
+  {
+    Ctx ctx("/search?q=cpp", "");
+    ctx.SetRemoteAddress("10.0.0.1");
+    // A transport calls Admit right after the headers, before reading the body
+    if (auto rejected = apis.Admit(ctx))
+    {
+      cout << rejected->status << " Retry-After: " << *rejected->FindHeader("Retry-After") << endl;
+      continue;
+    }
+    cout << apis.Handle(ctx).body << endl;
+  }
+  /**
+      result of cpp
+      result of cpp
+      result of cpp
+      429 Retry-After: 1
+  */
+
+  cout << apis.Test("/export", "", "X-Api-Key: a\r\n").status << endl;
+  cout << apis.Test("/export", "", "X-Api-Key: a\r\n").status << endl;
+  cout << apis.Test("/export", "", "X-Api-Key: b\r\n").status << endl;
+  /**
+      200
+      429
+      200
+  */
+}
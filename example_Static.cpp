@@ -0,0 +1,50 @@
+#include "restful.hpp"
+
+#include <filesystem>
+#include <fstream>
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  // The files served below
+  std::filesystem::create_directories("./www/css");
+  std::ofstream("./www/css/a.css") << "body{}";
+  std::ofstream("./www/big.bin", std::ios::binary) << std::string(300000, '\0');
+
+  Apis apis;
+
+  // Files up to 256KB are kept in memory, larger ones are served with sendfile by the transport
+  apis.RegisterStatic("/assets", "./www", {.cacheBudget = 16 << 20, .maxCachedFileSize = 256 << 10});
+
+  Ret ret = apis.Test("/assets/css/a.css");
+  cout << ret.status << " " << *ret.FindHeader("Content-Type") << " " << ret.GetBody() << endl;
+  /**
+      200 text/css; charset=utf-8 body{}
+  */
+
+  ret = apis.Test("/assets/css/a.css", "", "Range: bytes=0-3\r\n");
+  cout << ret.status << " " << *ret.FindHeader("Content-Range") << " " << ret.GetBody() << endl;
+  /**
+      206 bytes 0-3/6 body
+  */
+
+  ret = apis.Test("/assets/css/a.css", "", "If-None-Match: " + *ret.FindHeader("ETag") + "\r\n");
+  cout << ret.status << endl;
+  /**
+      304
+  */
+
+  ret = apis.Test("/assets/big.bin", "", "Range: bytes=-100\r\n");
+  cout << ret.status << " sendfile: " << ret.filePath << " " << ret.fileOffset << " " << ret.fileLength << endl;
+  /**
+      206 sendfile: ./www/big.bin 299900 100
+  */
+
+  ret = apis.Test("/assets/../secret");
+  cout << ret.status << endl;
+  /**
+      400
+  */
+}
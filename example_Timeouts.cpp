@@ -0,0 +1,53 @@
+#include "restful.hpp"
+
+using namespace std;
+using namespace Restful;
+
+int main()
+{
+  Apis apis;
+
+  // The deadline is visible to the handler, which gives up instead of hogging a worker
+  apis.RegisterRestful(
+      "/report",
+      [](Ctx& ctx) -> Ret
+      {
+        for (int step = 0; step < 100; ++step)
+        {
+          if (ctx.Expired())
+            return {.status = 504, .body = "gave up at step " + std::to_string(step)};
+          std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return {.body = "done"};
+      },
+      {.deadline = std::chrono::milliseconds(20)});
+
+  Ret ret = apis.Test("/report");
+  cout << ret.status << " " << ret.body << endl;
+  /**
+      504 gave up at step 1x
+  */
+
+  // One wheel per event loop: header-read, body-read, keep-alive and handler deadlines are O(1) to arm and cancel
+  ConnectionTimeouts timeouts{.headerRead = std::chrono::milliseconds(30)};
+  TimerWheel         wheel;
+
+  // A slowloris connection never finishes its headers
+  wheel.Arm(timeouts.headerRead, [] { cout << "connection 1: header timeout, close" << endl; });
+
+  // A well behaved connection finishes its headers, so its timer is cancelled
+  TimerWheel::TimerId header2 = wheel.Arm(timeouts.headerRead, [] { cout << "connection 2: header timeout" << endl; });
+  wheel.Cancel(header2);
+  wheel.Arm(std::chrono::milliseconds(50), [] { cout << "connection 2: keep-alive idle, close" << endl; });
+
+  // Event loop: epoll_wait(..., tick) then advance the wheel
+  while (wheel.Size())
+  {
+    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    wheel.Advance(TimerWheel::Clock::now());
+  }
+  /**
+      connection 1: header timeout, close
+      connection 2: keep-alive idle, close
+  */
+}
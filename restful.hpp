@@ -13,21 +13,49 @@
 #define __RESTFUL_H__
 
 #include <algorithm>
+#include <array>
+#include <atomic>
+#include <bit>
 #include <charconv>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+#include <list>
+#include <mutex>
+#include <optional>
 #include <memory>
 #include <stdexcept>
 #include <string>
 #include <string_view>
 #include <functional>
+#include <thread>
 #include <tuple>
 #include <type_traits>
 #include <map>
 #include <unordered_map>
+#include <utility>
 #include <vector>
 #include <iostream>
 
+// Define REST_USE_ZLIB (and link with -lz) to enable gzip/deflate response compression
+#ifdef REST_USE_ZLIB
+#include <zlib.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define REST_SSE2 1
+#include <emmintrin.h>
+#endif
+
 #ifdef _MSC_VER
 #define REST_MSVC 1
 #elif defined(__clang__)
@@ -38,22 +66,258 @@
 #error "Unknown compiler"
 #endif
 
+// Pooled buffer holding part of a segmented body, see Restful::JsonWriter
+struct BodyChunk
+{
+  static constexpr size_t capacity = 16 * 1024 - 64;
+
+  size_t size = 0;
+  char   data[capacity];
+
+  // Leaves data uninitialized
+  BodyChunk() {}
+
+  std::string_view view() const { return {data, size}; }
+};
+
 // Callback return type
 struct Ret
 {
+  int                                              status = 200;
+  std::vector<std::pair<std::string, std::string>> headers;
+  std::string                                      body;
+
+  // Served instead of body when set, e.g. shared with a cache without copying
+  std::shared_ptr<const std::string> sharedBody;
+
+  // Zero-copy file body, the transport should sendfile() this range after the headers
+  std::string   filePath;
+  std::uint64_t fileOffset = 0;
+  std::uint64_t fileLength = 0;
+
+  // Strong validator without quotes, computed from body when empty
+  std::string etag;
+  // 0 means unknown
+  std::time_t lastModified = 0;
+
+  // Body written in pooled chunks, served after body when not empty, each chunk is one iovec for writev()
+  std::vector<std::shared_ptr<const BodyChunk>> chunks;
+
+  // Whole response rendered ahead of time (status line, headers and body), see Restful::Apis::RegisterConstant
+  // When set the transport sends it as is with a single send(), the other fields are informational
+  std::shared_ptr<const std::string> wire;
+
+  // Contiguous part of the body, call Flatten() first when the whole body is needed in one piece
+  std::string_view GetBody() const { return sharedBody ? std::string_view(*sharedBody) : std::string_view(body); }
+
+  size_t BodySize() const
+  {
+    size_t size = GetBody().size();
+    for (auto& chunk: chunks)
+      size += chunk->size;
+    return size;
+  }
+
+  // Every non-empty segment of the body in order, e.g. to fill an iovec array
+  template<typename F>
+  void ForEachSegment(F&& f) const
+  {
+    if (!GetBody().empty())
+      f(GetBody());
+    for (auto& chunk: chunks)
+      if (chunk->size)
+        f(chunk->view());
+  }
+
+  // Copy the chunks into body and release them
+  void Flatten()
+  {
+    if (chunks.empty())
+      return;
+    std::string flat;
+    flat.reserve(BodySize());
+    ForEachSegment([&flat](std::string_view segment) { flat += segment; });
+    body = std::move(flat);
+    sharedBody.reset();
+    chunks.clear();
+  }
+
+  void ClearBody()
+  {
+    body.clear();
+    sharedBody.reset();
+    chunks.clear();
+  }
+
+  const std::string* FindHeader(const std::string_view& name) const
+  {
+    for (auto& [key, value]: headers)
+      if (key == name)
+        return &value;
+    return nullptr;
+  }
 };
 
 namespace Restful
 {
   class Apis;
-}
+
+  enum class Method : std::uint8_t
+  {
+    Get,
+    Head,
+    Post,
+    Put,
+    Delete,
+    Patch,
+    Options,
+    Other, // any other request method, only served by routes registered without a method
+  };
+
+  inline constexpr size_t methodCount = static_cast<size_t>(Method::Other);
+
+  inline constexpr std::string_view MethodName(Method method)
+  {
+    constexpr std::string_view names[] = {"GET", "HEAD", "POST", "PUT", "DELETE", "PATCH", "OPTIONS", ""};
+    return names[static_cast<size_t>(method)];
+  }
+
+  inline constexpr Method ParseMethod(std::string_view name)
+  {
+    for (size_t i = 0; i < methodCount; ++i)
+      if (MethodName(Method(i)) == name)
+        return Method(i);
+    return Method::Other;
+  }
+
+  namespace details
+  {
+    constexpr char to_lower(char c) { return (c >= 'A' && c <= 'Z') ? char(c | 0x20) : c; }
+
+    /**
+     * @brief First of c1 or c2 in [p, end), end if none, 16 bytes at a time with SSE2
+     */
+    inline const char* find_either(const char* p, const char* end, char c1, char c2)
+    {
+#if REST_SSE2
+      const __m128i v1 = _mm_set1_epi8(c1);
+      const __m128i v2 = _mm_set1_epi8(c2);
+      for (; end - p >= 16; p += 16)
+      {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int     mask  = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chunk, v1), _mm_cmpeq_epi8(chunk, v2)));
+        if (mask)
+          return p + std::countr_zero(static_cast<unsigned>(mask));
+      }
+#endif
+      for (; p < end; ++p)
+        if (*p == c1 || *p == c2)
+          return p;
+      return end;
+    }
+
+    /**
+     * @brief First byte in [p, end) that a JSON string must escape ('"', '\\' or below 0x20), 16 bytes at a time with SSE2
+     */
+    inline const char* find_json_escape(const char* p, const char* end)
+    {
+#if REST_SSE2
+      const __m128i quote     = _mm_set1_epi8('"');
+      const __m128i backslash = _mm_set1_epi8('\\');
+      const __m128i control   = _mm_set1_epi8(0x1F);
+      for (; end - p >= 16; p += 16)
+      {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // chunk <= 0x1F as unsigned
+        __m128i low  = _mm_cmpeq_epi8(_mm_max_epu8(chunk, control), control);
+        int     mask = _mm_movemask_epi8(
+            _mm_or_si128(low, _mm_or_si128(_mm_cmpeq_epi8(chunk, quote), _mm_cmpeq_epi8(chunk, backslash))));
+        if (mask)
+          return p + std::countr_zero(static_cast<unsigned>(mask));
+      }
+#endif
+      for (; p < end; ++p)
+        if (static_cast<unsigned char>(*p) < 0x20 || *p == '"' || *p == '\\')
+          return p;
+      return end;
+    }
+
+    struct header_field
+    {
+      std::string_view name;
+      std::string_view value;
+    };
+
+    /**
+     * @brief Cut the next "Name: value\r\n" line off block, lines without a colon are skipped
+     * @return false once block is exhausted
+     */
+    inline bool next_header(std::string_view& block, header_field& out)
+    {
+      auto trim = [](std::string_view v)
+      {
+        while (!v.empty() && (v.front() == ' ' || v.front() == '\t'))
+          v.remove_prefix(1);
+        while (!v.empty() && (v.back() == ' ' || v.back() == '\t' || v.back() == '\r'))
+          v.remove_suffix(1);
+        return v;
+      };
+
+      const char* end = block.data() + block.size();
+      while (!block.empty())
+      {
+        const char* begin = block.data();
+        const char* colon = find_either(begin, end, ':', '\n');
+        const char* eol   = colon < end && *colon == ':' ? find_either(colon, end, '\n', '\n') : colon;
+        block             = eol < end ? std::string_view(eol + 1, end - eol - 1) : std::string_view();
+
+        if (colon == eol || colon == begin)
+          continue;
+        out.name  = std::string_view(begin, colon - begin);
+        out.value = trim(std::string_view(colon + 1, eol - colon - 1));
+        return true;
+      }
+      return false;
+    }
+
+    /**
+     * @brief Cut the next "name=value" pair off a Cookie header, surrounding quotes of the value are removed
+     * @return false once src is exhausted
+     */
+    inline bool next_cookie(std::string_view& src, header_field& out)
+    {
+      while (!src.empty())
+      {
+        size_t           semicolon = src.find(';');
+        std::string_view pair      = src.substr(0, semicolon);
+        src                        = semicolon == std::string_view::npos ? std::string_view() : src.substr(semicolon + 1);
+
+        while (!pair.empty() && pair.front() == ' ')
+          pair.remove_prefix(1);
+        while (!pair.empty() && pair.back() == ' ')
+          pair.remove_suffix(1);
+
+        size_t eq = pair.find('=');
+        if (eq == 0 || eq == std::string_view::npos)
+          continue;
+        out.name  = pair.substr(0, eq);
+        out.value = pair.substr(eq + 1);
+        if (out.value.size() >= 2 && out.value.front() == '"' && out.value.back() == '"')
+          out.value = out.value.substr(1, out.value.size() - 2);
+        return true;
+      }
+      return false;
+    }
+  } // namespace details
+} // namespace Restful
 
 // Callback arg0 type
 struct Ctx
 {
   friend class Restful::Apis;
 
-  Ctx(const std::string& _url, const std::string& _contentBody): url(_url), contentBody(_contentBody)
+  Ctx(const std::string& _url, const std::string& _contentBody, const std::string& _headers = "")
+      : url(_url), contentBody(_contentBody), headers(_headers)
   {
     urlParamBegin = url.find_first_of('?');
     if (urlParamBegin == std::string::npos)
@@ -90,6 +354,12 @@ struct Ctx
 
   std::string_view GetUrlWithoutParams() const { return urlWithoutParams; }
 
+  // Values of the route pattern variables, in pattern order, e.g. "/user/{id}/post/{pid}" -> [id, pid]
+  static constexpr size_t maxPathVars = 8;
+
+  std::string_view GetPathVar(size_t idx) const { return idx < pathVarCount ? pathVars[idx] : std::string_view(); }
+  size_t           GetPathVarCount() const { return pathVarCount; }
+
   std::string_view GetRawUrlParams() const
   {
     if (urlWithoutParams.size() < url.size())
@@ -99,6 +369,88 @@ struct Ctx
 
   std::string_view GetRawContentBody() const { return contentBody; }
 
+  // Body read after Apis::Admit accepted the headers
+  void SetContentBody(std::string body)
+  {
+    contentBody       = std::move(body);
+    contentParamBegin = 0;
+    std::erase_if(parsedParams, [](const auto& kv) { return kv.first.type == ParamKey::Content; });
+  }
+
+  // "Expect: 100-continue", the client waits for an interim response before sending the body
+  bool ExpectsContinue() const
+  {
+    std::string_view expect = GetHeaderLowercase("expect");
+    return expect.size() == 12 && std::equal(expect.begin(), expect.end(), "100-continue",
+                                             [](char a, char b) { return Restful::details::to_lower(a) == b; });
+  }
+
+  std::string_view GetRawHeaders() const { return headers; }
+
+  // Request method, filled in by the transport, GET by default
+  void           SetMethod(Restful::Method m) { method = m; }
+  void           SetMethod(std::string_view name) { method = Restful::ParseMethod(name); }
+  Restful::Method GetMethod() const { return method; }
+
+  // Peer address, filled in by the transport
+  void             SetRemoteAddress(std::string addr) { remoteAddress = std::move(addr); }
+  std::string_view GetRemoteAddress() const { return remoteAddress; }
+
+  /**
+   * @brief Handler deadline, set from RouteOptions::deadline when the request is admitted
+   * @brief Long running handlers should poll Expired() and abandon work early
+   */
+  void SetDeadline(std::chrono::steady_clock::time_point tp) { deadline = tp; }
+  bool HasDeadline() const { return deadline != std::chrono::steady_clock::time_point::max(); }
+  bool Expired() const { return HasDeadline() && std::chrono::steady_clock::now() >= deadline; }
+
+  std::chrono::steady_clock::time_point GetDeadline() const { return deadline; }
+
+  /**
+   * @brief Case-insensitive lookup in the "Name: value\r\n" header block
+   * @brief The block is indexed on first use, the first maxIndexedHeaders headers as views without allocating
+   */
+  std::string_view GetHeader(const std::string_view& name) const
+  {
+    std::array<char, 64> lower;
+    if (name.size() > lower.size())
+      return findHeader(name, false);
+    std::transform(name.begin(), name.end(), lower.begin(), Restful::details::to_lower);
+    return findHeader(std::string_view(lower.data(), name.size()), true);
+  }
+
+  /**
+   * @brief GetHeader for a name that is already lowercase, e.g. computed at compile time
+   */
+  std::string_view GetHeaderLowercase(const std::string_view& name) const { return findHeader(name, true); }
+
+  /**
+   * @brief Cookie by name (case-sensitive), the Cookie header is only tokenized when a cookie is first asked for
+   */
+  std::string_view GetCookie(const std::string_view& name) const
+  {
+    if (!cookiesIndexed)
+    {
+      cookiesIndexed   = true;
+      unindexedCookies = GetHeaderLowercase("cookie");
+
+      Restful::details::header_field field;
+      while (cookieCount < maxIndexedCookies && Restful::details::next_cookie(unindexedCookies, field))
+        cookieFields[cookieCount++] = field;
+    }
+
+    for (size_t i = 0; i < cookieCount; ++i)
+      if (cookieFields[i].name == name)
+        return cookieFields[i].value;
+
+    std::string_view               src = unindexedCookies;
+    Restful::details::header_field field;
+    while (Restful::details::next_cookie(src, field))
+      if (field.name == name)
+        return field.value;
+    return {};
+  }
+
   std::string_view GetUrlParam(const std::string_view& key)
   {
     auto it = parsedParams.find({ParamKey::Url, key});
@@ -185,16 +537,115 @@ struct Ctx
     return {};
   }
 
+  /**
+   * @brief Call cb(value) for every occurrence of key, GetUrlParam only returns the first one
+   * @return false as soon as cb returns false
+   */
+  template<typename Callback>
+  bool ForEachUrlParam(const std::string_view& key, Callback&& cb) const
+  {
+    return forEachParam(GetRawUrlParams(), key, cb);
+  }
+
+  template<typename Callback>
+  bool ForEachContentParam(const std::string_view& key, Callback&& cb) const
+  {
+    return forEachParam(contentBody, key, cb);
+  }
+
 protected:
   void adjustRestBegin(size_t pos) { restBegin = pos; }
 
+  template<typename Callback>
+  static bool forEachParam(std::string_view params, const std::string_view& key, Callback& cb)
+  {
+    while (!params.empty())
+    {
+      size_t           amp  = params.find('&');
+      std::string_view pair = params.substr(0, amp);
+      params                = amp == std::string_view::npos ? std::string_view() : params.substr(amp + 1);
+
+      size_t eq = pair.find('=');
+      if (eq == key.size() && pair.substr(0, eq) == key && !cb(pair.substr(eq + 1)))
+        return false;
+    }
+    return true;
+  }
+
+  void indexHeaders() const
+  {
+    headersIndexed = true;
+
+    std::string_view               block = headers;
+    Restful::details::header_field field;
+    while (headerCount < maxIndexedHeaders && Restful::details::next_header(block, field))
+      headerFields[headerCount++] = field;
+    unindexedHeaders = block;
+  }
+
+  std::string_view findHeader(const std::string_view& name, bool lowercase) const
+  {
+    auto equal = [&name, lowercase](std::string_view candidate)
+    {
+      if (candidate.size() != name.size())
+        return false;
+      for (size_t i = 0; i < name.size(); ++i)
+      {
+        char c = lowercase ? name[i] : Restful::details::to_lower(name[i]);
+        if (Restful::details::to_lower(candidate[i]) != c)
+          return false;
+      }
+      return true;
+    };
+
+    if (!headersIndexed)
+      indexHeaders();
+    for (size_t i = 0; i < headerCount; ++i)
+      if (equal(headerFields[i].name))
+        return headerFields[i].value;
+
+    // Past the inline index, rare enough to scan
+    std::string_view               block = unindexedHeaders;
+    Restful::details::header_field field;
+    while (Restful::details::next_header(block, field))
+      if (equal(field.name))
+        return field.value;
+    return {};
+  }
+
   std::string      url;
   std::string_view urlWithoutParams;
   std::string      contentBody;
+  std::string      headers;
+  std::string      remoteAddress;
+  Restful::Method  method = Restful::Method::Get;
   size_t           restBegin         = 0;
   size_t           urlParamBegin     = 0;
   size_t           contentParamBegin = 0;
 
+  std::array<std::string_view, maxPathVars> pathVars;
+  std::uint8_t                              pathVarCount = 0;
+
+  static constexpr size_t maxIndexedHeaders = 32;
+
+  // Built lazily by const lookups
+  mutable std::array<Restful::details::header_field, maxIndexedHeaders> headerFields;
+  mutable std::uint8_t                                                  headerCount    = 0;
+  mutable bool                                                          headersIndexed = false;
+  mutable std::string_view                                              unindexedHeaders;
+
+  static constexpr size_t maxIndexedCookies = 16;
+
+  mutable std::array<Restful::details::header_field, maxIndexedCookies> cookieFields;
+  mutable std::uint8_t                                                  cookieCount    = 0;
+  mutable bool                                                          cookiesIndexed = false;
+  mutable std::string_view                                              unindexedCookies;
+
+  // Set once Apis::Admit passed, so rate limits and admission control are not charged twice
+  bool admitted = false;
+
+  std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+
   struct ParamKey
   {
     enum EParam : std::uint8_t
@@ -230,6 +681,35 @@ namespace Restful
   {
   };
 
+  /**
+   * @brief Max Count Tag
+   * @brief bounds the values collected by a std::vector param, more values are rejected with 400
+   */
+  template<size_t N>
+  struct MaxCount
+  {
+  };
+
+  inline constexpr size_t defaultMaxCount = 1024;
+
+  /**
+   * @brief Range Tag
+   * @brief a value outside [Min, Max] is rejected with 400, e.g. UrlParam<int, "page", Range<1, 1000>>
+   */
+  template<auto Min, auto Max>
+  struct Range
+  {
+  };
+
+  /**
+   * @brief Max Length Tag
+   * @brief a string (or list) longer than N is rejected with 400
+   */
+  template<size_t N>
+  struct MaxLength
+  {
+  };
+
   template<typename T, typename _ = void>
   struct DefaultValue
   {
@@ -262,84 +742,729 @@ namespace Restful
       constexpr std::string_view view() const { return {val, N - 1}; }
     };
 
-    template<typename T, typename Tuple, size_t Begin, size_t End, bool Stop>
-    struct get_default_value_impl
+    template<size_t N>
+    constexpr string_literal<N> to_lower(string_literal<N> s)
+    {
+      for (auto& c: s.val)
+        c = to_lower(c);
+      return s;
+    }
+
+    template<typename T>
+    struct is_vector: std::false_type
     {
     };
-    template<typename T, typename Tuple, size_t Begin, size_t End>
-    struct get_default_value_impl<T, Tuple, Begin, End, true>
+    template<typename T>
+    struct is_vector<std::vector<T>>: std::true_type
     {
-      using type = void;
     };
-    template<typename T, typename Tuple, size_t Begin, size_t End>
-    struct get_default_value_impl<T, Tuple, Begin, End, false>
-        : std::conditional_t<std::is_base_of_v<DefaultValue<T>, std::tuple_element_t<Begin, Tuple>>,
-                             std::tuple_element<Begin, Tuple>,
-                             get_default_value_impl<T, Tuple, Begin + 1, End, Begin + 1 >= End>>
+
+    template<typename T>
+    struct member_type
     {
     };
-    template<typename T, typename Tuple, size_t Begin = 0, size_t End = std::tuple_size_v<Tuple>>
-    struct get_default_value: get_default_value_impl<T, Tuple, Begin, End, Begin >= End>
+    template<typename C, typename T>
+    struct member_type<T C::*>
     {
+      using type       = T;
+      using class_type = C;
     };
-  } // namespace details
 
-  template<typename T, typename... Args>
-  struct PathParam
-  {
-    using type      = T;
-    using pointer   = T*;
-    using reference = T&;
+    // Aggregates declaring "using fields = std::tuple<Field<...>...>"
+    template<typename T>
+    concept has_fields = requires { typename T::fields; };
 
-    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
-    pointer               obj;
+    template<typename T>
+    struct max_count_of: std::integral_constant<size_t, 0>
+    {
+    };
+    template<size_t N>
+    struct max_count_of<MaxCount<N>>: std::integral_constant<size_t, N>
+    {
+    };
 
-    operator bool() const { return obj != nullptr; }
+    template<typename... Args>
+    constexpr size_t max_count()
+    {
+      size_t n = std::max({size_t(0), max_count_of<Args>::value...});
+      return n ? n : defaultMaxCount;
+    }
 
-    reference operator*() { return *obj; }
+    /**
+     * @brief Decimal integer, up to 8 plain digits are converted at once with SWAR, anything else through from_chars
+     */
+    template<typename T>
+    inline bool parse_integer(std::string_view src, T& out)
+    {
+      if constexpr (std::endian::native == std::endian::little)
+      {
+        if (!src.empty() && src.size() <= 8)
+        {
+          // Right aligned, the padding reads as leading zeros
+          std::uint64_t v = 0x3030303030303030;
+          std::memcpy(reinterpret_cast<char*>(&v) + 8 - src.size(), src.data(), src.size());
 
-    pointer operator->() { return obj; }
+          // Every byte within '0'..'9'
+          if (((v & 0xF0F0F0F0F0F0F0F0) | (((v + 0x0606060606060606) & 0xF0F0F0F0F0F0F0F0) >> 4)) ==
+              0x3333333333333333)
+          {
+            v -= 0x3030303030303030;
+            v = (v * 10) + (v >> 8);
+            v = (((v & 0x000000FF000000FF) * 0x000F424000000064) +
+                 (((v >> 16) & 0x000000FF000000FF) * 0x0000271000000001)) >>
+                32;
+            if (v > static_cast<std::uint64_t>(std::numeric_limits<T>::max()))
+              return false;
+            out = static_cast<T>(v);
+            return true;
+          }
+        }
+      }
+      auto [ptr, ec] = std::from_chars(src.data(), src.data() + src.size(), out);
+      return ec == std::errc() && ptr == src.data() + src.size();
+    }
 
-    PathParam(void* pobj): obj((pointer)pobj) {}
+    enum class SegmentKind : std::uint8_t
+    {
+      Literal,
+      Uint, // {name:uint}
+      Int,  // {name:int}
+      Str,  // {name} or {name:str}
+    };
 
-    friend std::ostream& operator<<(std::ostream& os, PathParam<T, Args...>& o)
+    /**
+     * @brief One '/' separated piece of a route pattern, text is the literal or the variable name
+     */
+    struct pattern_segment
     {
-      if (o.obj)
-        os << *o;
-      return os;
-    }
+      SegmentKind      kind = SegmentKind::Literal;
+      std::string_view text;
+    };
 
-    static T* MakeDefaultValue()
+    constexpr size_t route_segment_count(std::string_view path)
     {
-      using type = typename details::get_default_value<T, std::tuple<Args...>>::type;
-      if constexpr (std::is_same_v<type, void>)
-        return nullptr;
-      else
-        return new T(type::get_default_value());
+      return std::count(path.begin(), path.end(), '/');
     }
-  };
 
-  template<typename T, details::string_literal Key, typename... Args>
-  struct UrlParam
-  {
-    constexpr static details::string_literal key = Key;
+    /**
+     * @brief Split "/user/{id:int}/post/{pid}" into route_segment_count(path) segments
+     * @return false if a segment is not a literal or a whole "{name[:type]}" variable
+     */
+    constexpr bool parse_route(std::string_view path, pattern_segment* out)
+    {
+      if (path.empty() || path[0] != '/')
+        return false;
 
-    using type      = T;
-    using pointer   = T*;
-    using reference = T&;
+      for (size_t begin = 1;; ++out)
+      {
+        size_t           end     = std::min(path.find('/', begin), path.size());
+        std::string_view segment = path.substr(begin, end - begin);
 
-    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
-    pointer               obj;
+        if (segment.find_first_of("{}") == std::string_view::npos)
+          *out = {SegmentKind::Literal, segment};
+        else
+        {
+          if (segment.size() < 3 || segment.front() != '{' || segment.back() != '}')
+            return false;
 
-    operator bool() const { return obj != nullptr; }
+          std::string_view var   = segment.substr(1, segment.size() - 2);
+          size_t           colon = var.find(':');
+          std::string_view name  = var.substr(0, colon);
+          std::string_view type  = colon == std::string_view::npos ? "str" : var.substr(colon + 1);
+          if (name.empty() || name.find_first_of("{}:") != std::string_view::npos)
+            return false;
 
-    reference operator*() { return *obj; }
+          if (type == "uint")
+            *out = {SegmentKind::Uint, name};
+          else if (type == "int")
+            *out = {SegmentKind::Int, name};
+          else if (type == "str")
+            *out = {SegmentKind::Str, name};
+          else
+            return false;
+        }
 
-    pointer operator->() { return obj; }
+        if (end == path.size())
+          return true;
+        begin = end + 1;
+      }
+    }
 
-    UrlParam(void* pobj): obj((pointer)pobj) {}
+    /**
+     * @brief Route pattern parsed at compile time, PathVar keys are resolved to variable indices here
+     */
+    template<string_literal Pattern>
+    struct route_pattern
+    {
+      static constexpr std::string_view path = Pattern.view();
+      static constexpr size_t           size = route_segment_count(path);
 
-    friend std::ostream& operator<<(std::ostream& os, UrlParam<T, Key, Args...>& o)
+      struct parsed
+      {
+        std::array<pattern_segment, size> segments{};
+        bool                              valid = false;
+      };
+
+      static constexpr parsed result = []
+      {
+        parsed ret;
+        ret.valid = parse_route(path, ret.segments.data());
+        return ret;
+      }();
+
+      static constexpr bool valid = result.valid;
+
+      static constexpr size_t var_count = []
+      {
+        size_t count = 0;
+        for (auto& segment: result.segments)
+          count += segment.kind != SegmentKind::Literal;
+        return count;
+      }();
+
+      static constexpr bool unique_names = []
+      {
+        for (size_t i = 0; i < size; ++i)
+          for (size_t j = i + 1; j < size; ++j)
+            if (result.segments[i].kind != SegmentKind::Literal && result.segments[j].kind != SegmentKind::Literal &&
+                result.segments[i].text == result.segments[j].text)
+              return false;
+        return true;
+      }();
+
+      static constexpr size_t index_of(std::string_view name)
+      {
+        size_t idx = 0;
+        for (auto& segment: result.segments)
+        {
+          if (segment.kind == SegmentKind::Literal)
+            continue;
+          if (segment.text == name)
+            return idx;
+          ++idx;
+        }
+        return std::string_view::npos;
+      }
+    };
+
+    template<typename T, typename Tuple, size_t Begin, size_t End, bool Stop>
+    struct get_default_value_impl
+    {
+    };
+    template<typename T, typename Tuple, size_t Begin, size_t End>
+    struct get_default_value_impl<T, Tuple, Begin, End, true>
+    {
+      using type = void;
+    };
+    template<typename T, typename Tuple, size_t Begin, size_t End>
+    struct get_default_value_impl<T, Tuple, Begin, End, false>
+        : std::conditional_t<std::is_base_of_v<DefaultValue<T>, std::tuple_element_t<Begin, Tuple>>,
+                             std::tuple_element<Begin, Tuple>,
+                             get_default_value_impl<T, Tuple, Begin + 1, End, Begin + 1 >= End>>
+    {
+    };
+    template<typename T, typename Tuple, size_t Begin = 0, size_t End = std::tuple_size_v<Tuple>>
+    struct get_default_value: get_default_value_impl<T, Tuple, Begin, End, Begin >= End>
+    {
+    };
+  } // namespace details
+
+  /**
+   * @brief One Of Tag
+   * @brief a value outside the listed set is rejected with 400, e.g. UrlParam<std::string, "order", OneOf<"asc", "desc">>
+   */
+  template<details::string_literal... Values>
+  struct OneOf
+  {
+  };
+
+  namespace details
+  {
+    template<typename T, typename Tag>
+    struct constraint
+    {
+      static constexpr bool active = false;
+
+      static bool check(const T&) { return true; }
+    };
+
+    template<typename T, auto Min, auto Max>
+    struct constraint<T, Range<Min, Max>>
+    {
+      static constexpr bool active = true;
+
+      static bool check(const T& v)
+      {
+        if constexpr (std::is_integral_v<T> && std::is_integral_v<decltype(Min)> && std::is_integral_v<decltype(Max)>)
+          return !std::cmp_less(v, Min) && !std::cmp_greater(v, Max);
+        else
+          return !(v < Min) && !(Max < v);
+      }
+    };
+
+    template<typename T, size_t N>
+    struct constraint<T, MaxLength<N>>
+    {
+      static constexpr bool active = true;
+
+      static bool check(const T& v) { return v.size() <= N; }
+    };
+
+    template<typename T, string_literal... Values>
+    struct constraint<T, OneOf<Values...>>
+    {
+      static constexpr bool active = true;
+
+      static bool check(const T& v) { return ((std::string_view(v) == Values.view()) || ...); }
+    };
+
+    template<typename T, typename... Args>
+    inline constexpr bool has_constraints = (constraint<T, Args>::active || ...);
+
+    // Range, MaxLength and OneOf tags of a param, the other tags always pass
+    template<typename T, typename... Args>
+    inline bool satisfies(const T& v)
+    {
+      return (constraint<T, Args>::check(v) && ...);
+    }
+  } // namespace details
+
+  /**
+   * @brief Accepted spelling of an enumerator, enums get a convertor by declaring their names beside the type
+   *
+   * @example
+    enum class Color { Red, Green, Blue };
+    constexpr std::array<Restful::EnumName<Color>, 3> RestfulEnumNames(Color)
+    {
+      return {{{"red", Color::Red}, {"green", Color::Green}, {"blue", Color::Blue}}};
+    }
+   */
+  template<typename E>
+  struct EnumName
+  {
+    std::string_view name;
+    E                value;
+  };
+
+  namespace details
+  {
+    // Enums declaring RestfulEnumNames(E), found by ADL
+    template<typename E>
+    concept has_enum_names = std::is_enum_v<E> && requires { RestfulEnumNames(E{}); };
+
+    /**
+     * @brief Perfect hash over a fixed set of names, built at compile time (hash and displace)
+     * @brief A lookup is one FNV-1a pass over the input, a displaced mix into the slots, then one memcmp, no allocation
+     */
+    template<typename T, size_t N>
+    struct perfect_hash
+    {
+      static_assert(N > 0 && N < 0x8000, "perfect_hash needs 1 to 32767 names");
+
+      static constexpr size_t buckets = std::bit_ceil(N);
+      static constexpr size_t size    = buckets * 2;
+
+      std::array<EnumName<T>, N> names;
+      // Per bucket seed of the second level
+      std::array<std::uint32_t, buckets> displace{};
+      // Index + 1 into names, 0 is an empty slot
+      std::array<std::uint16_t, size> slots{};
+
+      static constexpr std::uint32_t hash(std::string_view s)
+      {
+        std::uint32_t h = 0x811C9DC5u;
+        for (char c: s)
+          h = (h ^ std::uint8_t(c)) * 0x01000193u;
+        return h;
+      }
+
+      static constexpr std::uint32_t slot(std::uint32_t h, std::uint32_t d)
+      {
+        // murmur3 finalizer
+        h ^= d * 0x9E3779B9u;
+        h ^= h >> 16;
+        h *= 0x85EBCA6Bu;
+        h ^= h >> 13;
+        h *= 0xC2B2AE35u;
+        h ^= h >> 16;
+        return h & (size - 1);
+      }
+
+      constexpr perfect_hash(const std::array<EnumName<T>, N>& _names): names(_names)
+      {
+        std::array<std::uint32_t, N> hashes{};
+        std::array<size_t, buckets>  counts{};
+        for (size_t i = 0; i < N; ++i)
+        {
+          for (size_t j = 0; j < i; ++j)
+            if (names[i].name == names[j].name)
+              throw std::logic_error("duplicate name");
+          hashes[i] = hash(names[i].name);
+          ++counts[hashes[i] & (buckets - 1)];
+        }
+
+        // Largest buckets first, while most slots are still free
+        std::array<size_t, N> members{};
+        std::array<size_t, N> taken{};
+        for (size_t n = N; n > 0; --n)
+        {
+          for (size_t b = 0; b < buckets; ++b)
+          {
+            if (counts[b] != n)
+              continue;
+            for (size_t i = 0, m = 0; i < N; ++i)
+              if ((hashes[i] & (buckets - 1)) == b)
+                members[m++] = i;
+
+            for (std::uint32_t d = 1;; ++d)
+            {
+              if (d == 0x100000)
+                throw std::logic_error("no perfect hash found");
+
+              size_t m = 0;
+              for (; m < n; ++m)
+              {
+                taken[m] = slot(hashes[members[m]], d);
+                if (slots[taken[m]] || std::find(taken.begin(), taken.begin() + m, taken[m]) != taken.begin() + m)
+                  break;
+              }
+              if (m < n)
+                continue;
+
+              for (m = 0; m < n; ++m)
+                slots[taken[m]] = std::uint16_t(members[m] + 1);
+              displace[b] = d;
+              break;
+            }
+          }
+        }
+      }
+
+      const EnumName<T>* find(std::string_view s) const
+      {
+        std::uint32_t h = hash(s);
+        std::uint16_t i = slots[slot(h, displace[h & (buckets - 1)])];
+        if (!i)
+          return nullptr;
+        const EnumName<T>& e = names[i - 1];
+        return e.name.size() == s.size() && std::memcmp(e.name.data(), s.data(), s.size()) == 0 ? &e : nullptr;
+      }
+    };
+
+    template<typename E>
+    inline constexpr perfect_hash enum_names{RestfulEnumNames(E{})};
+
+    inline constexpr perfect_hash bool_names{std::array<EnumName<bool>, 6>{{
+        {"true", true},
+        {"false", false},
+        {"1", true},
+        {"0", false},
+        {"yes", true},
+        {"no", false},
+    }}};
+
+    template<typename T>
+    struct is_duration: std::false_type
+    {
+    };
+    template<typename Rep, typename Period>
+    struct is_duration<std::chrono::duration<Rep, Period>>: std::true_type
+    {
+    };
+
+    template<typename T>
+    struct is_sys_time: std::false_type
+    {
+    };
+    template<typename Duration>
+    struct is_sys_time<std::chrono::sys_time<Duration>>: std::true_type
+    {
+    };
+
+    /**
+     * @brief Check the first 16 bytes of s against a fixed layout, digits where digits is set, the byte of layout elsewhere
+     * @brief With SSE2 all positions are checked at once, positions past the end read as '\0'
+     */
+    inline bool match_layout(const char (&s)[16], const char (&layout)[17], std::uint32_t digits, std::uint32_t literals)
+    {
+#ifdef REST_SSE2
+      __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(s));
+      __m128i d = _mm_sub_epi8(v, _mm_set1_epi8('0'));
+      // d <= 9 as unsigned
+      __m128i isDigit = _mm_cmpeq_epi8(_mm_min_epu8(d, _mm_set1_epi8(9)), d);
+      __m128i isSame  = _mm_cmpeq_epi8(v, _mm_loadu_si128(reinterpret_cast<const __m128i*>(layout)));
+      return (std::uint32_t(_mm_movemask_epi8(isDigit)) & digits) == digits &&
+             (std::uint32_t(_mm_movemask_epi8(isSame)) & literals) == literals;
+#else
+      std::uint32_t bad = 0;
+      for (int i = 0; i < 16; ++i)
+      {
+        std::uint32_t bit = 1u << i;
+        bad |= (digits & bit) && std::uint8_t(s[i] - '0') > 9;
+        bad |= (literals & bit) && s[i] != layout[i];
+      }
+      return !bad;
+#endif
+    }
+
+    inline int two_digits(const char* p) { return (p[0] - '0') * 10 + (p[1] - '0'); }
+
+    /**
+     * @brief "YYYY-MM-DD", the only layout accepted for a date
+     */
+    inline bool parse_date(std::string_view src, std::chrono::year_month_day& out)
+    {
+      if (src.size() != 10)
+        return false;
+      char s[16] = {};
+      std::memcpy(s, src.data(), 10);
+      if (!match_layout(s, "0000-00-00      ", 0b1101101111, 0b0010010000))
+        return false;
+
+      out = std::chrono::year(two_digits(s) * 100 + two_digits(s + 2)) / two_digits(s + 5) / two_digits(s + 8);
+      return out.ok();
+    }
+
+    /**
+     * @brief "YYYY-MM-DD" or "YYYY-MM-DDTHH:MM:SS[.fraction][Z|+HH:MM|-HH:MM|+HHMM|-HHMM]", 'T' may also be 't' or ' '
+     * @brief No offset reads as UTC, digits of the fraction past nanoseconds are checked and dropped
+     */
+    inline bool parse_date_time(std::string_view src, std::chrono::sys_seconds& out, std::chrono::nanoseconds& fraction)
+    {
+      using namespace std::chrono;
+
+      fraction = nanoseconds::zero();
+      if (src.size() == 10)
+      {
+        year_month_day ymd;
+        if (!parse_date(src, ymd))
+          return false;
+        out = sys_days(ymd);
+        return true;
+      }
+      if (src.size() < 19)
+        return false;
+
+      char s[16];
+      std::memcpy(s, src.data(), 16);
+      if (!match_layout(s, "0000-00-00T00:00", 0b1101101101101111, 0b0010000010010000) ||
+          !(s[10] == 'T' || s[10] == 't' || s[10] == ' ') || src[16] != ':' || std::uint8_t(src[17] - '0') > 9 ||
+          std::uint8_t(src[18] - '0') > 9)
+        return false;
+
+      year_month_day ymd = year(two_digits(s) * 100 + two_digits(s + 2)) / two_digits(s + 5) / two_digits(s + 8);
+      int            hh = two_digits(s + 11), mm = two_digits(s + 14), ss = two_digits(src.data() + 17);
+      if (!ymd.ok() || hh > 23 || mm > 59 || ss > 59)
+        return false;
+
+      const char* p   = src.data() + 19;
+      const char* end = src.data() + src.size();
+      if (p != end && *p == '.')
+      {
+        const char*   digits = ++p;
+        std::int64_t  ns     = 0;
+        std::int64_t  scale  = 100000000;
+        for (; p != end && std::uint8_t(*p - '0') <= 9; ++p, scale /= 10)
+          ns += (*p - '0') * scale;
+        if (p == digits)
+          return false;
+        fraction = nanoseconds(ns);
+      }
+
+      seconds offset{};
+      if (p != end)
+      {
+        if (*p == 'Z' || *p == 'z')
+          ++p;
+        else if (*p == '+' || *p == '-')
+        {
+          // +HH:MM or +HHMM
+          size_t rest = end - p;
+          if (rest != 6 && rest != 5)
+            return false;
+          const char* m = p + (rest == 6 ? 4 : 3);
+          if (std::uint8_t(p[1] - '0') > 9 || std::uint8_t(p[2] - '0') > 9 || (rest == 6 && p[3] != ':') ||
+              std::uint8_t(m[0] - '0') > 9 || std::uint8_t(m[1] - '0') > 9)
+            return false;
+          int oh = two_digits(p + 1), om = two_digits(m);
+          if (oh > 23 || om > 59)
+            return false;
+          offset = hours(oh) + minutes(om);
+          if (*p == '-')
+            offset = -offset;
+          p = end;
+        }
+      }
+      if (p != end)
+        return false;
+
+      out = sys_days(ymd) + hours(hh) + minutes(mm) + seconds(ss) - offset;
+      return true;
+    }
+
+    /**
+     * @brief Unsigned decimal with an optional ".fraction", fraction digits past nanoseconds are checked and dropped
+     */
+    struct decimal
+    {
+      std::uint64_t whole = 0;
+      std::int64_t  frac  = 0;
+      std::int64_t  scale = 1;
+    };
+
+    inline bool parse_decimal(const char*& p, const char* end, decimal& out)
+    {
+      const char* begin = p;
+      out               = {};
+      for (; p != end && std::uint8_t(*p - '0') <= 9; ++p)
+      {
+        if (out.whole > (std::numeric_limits<std::uint64_t>::max() - 9) / 10)
+          return false;
+        out.whole = out.whole * 10 + (*p - '0');
+      }
+      bool any = p != begin;
+      if (p != end && (*p == '.' || *p == ','))
+      {
+        const char* digits = ++p;
+        for (; p != end && std::uint8_t(*p - '0') <= 9; ++p)
+          if (out.scale < 1000000000)
+          {
+            out.frac = out.frac * 10 + (*p - '0');
+            out.scale *= 10;
+          }
+        any |= p != digits;
+      }
+      return any;
+    }
+
+    /**
+     * @brief value * unit added to total, false on overflow
+     */
+    inline bool accumulate(std::int64_t& total, const decimal& value, std::int64_t unit)
+    {
+      constexpr std::int64_t max = std::numeric_limits<std::int64_t>::max();
+      if (value.whole > std::uint64_t(max / unit))
+        return false;
+      // frac / scale < 1, split unit so that neither product overflows
+      std::int64_t v = std::int64_t(value.whole) * unit + (unit / value.scale) * value.frac +
+                       (unit % value.scale) * value.frac / value.scale;
+      if (v < 0 || v > max - total)
+        return false;
+      total += v;
+      return true;
+    }
+
+    /**
+     * @brief "PnWnDTnHnMnS" (ISO-8601, seconds may have a fraction), or units such as "1h30m", "15m", "500ms", "2.5s"
+     * @brief Units are w, d, h, m, s, ms, us, ns, either form may start with '-', years and months are rejected as ambiguous
+     */
+    inline bool parse_duration(std::string_view src, std::chrono::nanoseconds& out)
+    {
+      constexpr std::int64_t us = 1000, ms = 1000 * us, sec = 1000 * ms, min = 60 * sec, hour = 60 * min,
+                             day = 24 * hour, week = 7 * day;
+
+      const char* p   = src.data();
+      const char* end = p + src.size();
+      bool        neg = p != end && *p == '-';
+      p += neg;
+      if (p == end)
+        return false;
+
+      std::int64_t total = 0;
+
+      if (*p == 'P' || *p == 'p')
+      {
+        // Designators must appear in this order, each at most once
+        static constexpr char         order[] = "WDTHMS";
+        static constexpr std::int64_t units[] = {week, day, 0, hour, min, sec};
+
+        int  next = 0;
+        bool time = false, any = false;
+        for (++p; p != end;)
+        {
+          if (*p == 'T' || *p == 't')
+          {
+            if (time || next > 2)
+              return false;
+            time = true;
+            next = 3;
+            ++p;
+            continue;
+          }
+
+          decimal v;
+          if (!parse_decimal(p, end, v) || p == end)
+            return false;
+          char c = char(*p++ & ~0x20);
+          int  i = next;
+          while (i < 6 && order[i] != c)
+            ++i;
+          // W and D before T, H M S after it, only seconds may have a fraction
+          if (i == 6 || i == 2 || (i > 2) != time || (i != 5 && v.scale != 1))
+            return false;
+          if (!accumulate(total, v, units[i]))
+            return false;
+          next = i + 1;
+          any  = true;
+        }
+        if (!any || (time && next == 3))
+          return false;
+      }
+      else
+      {
+        while (p != end)
+        {
+          decimal v;
+          if (!parse_decimal(p, end, v) || p == end)
+            return false;
+          std::int64_t unit;
+          if (*p == 'n' && p + 1 != end && p[1] == 's')
+            unit = 1, p += 2;
+          else if (*p == 'u' && p + 1 != end && p[1] == 's')
+            unit = us, p += 2;
+          else if (*p == 'm' && p + 1 != end && p[1] == 's')
+            unit = ms, p += 2;
+          else if (*p == 's')
+            unit = sec, ++p;
+          else if (*p == 'm')
+            unit = min, ++p;
+          else if (*p == 'h')
+            unit = hour, ++p;
+          else if (*p == 'd')
+            unit = day, ++p;
+          else if (*p == 'w')
+            unit = week, ++p;
+          else
+            return false;
+          if (!accumulate(total, v, unit))
+            return false;
+        }
+      }
+
+      out = std::chrono::nanoseconds(neg ? -total : total);
+      return true;
+    }
+  } // namespace details
+
+  template<typename T, typename... Args>
+  struct PathParam
+  {
+    using type      = T;
+    using pointer   = T*;
+    using reference = T&;
+
+    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
+    pointer               obj;
+
+    operator bool() const { return obj != nullptr; }
+
+    reference operator*() { return *obj; }
+
+    pointer operator->() { return obj; }
+
+    PathParam(void* pobj): obj((pointer)pobj) {}
+
+    friend std::ostream& operator<<(std::ostream& os, PathParam<T, Args...>& o)
     {
       if (o.obj)
         os << *o;
@@ -357,7 +1482,7 @@ namespace Restful
   };
 
   template<typename T, details::string_literal Key, typename... Args>
-  struct PostParam
+  struct UrlParam
   {
     constexpr static details::string_literal key = Key;
 
@@ -374,9 +1499,9 @@ namespace Restful
 
     pointer operator->() { return obj; }
 
-    PostParam(void* pobj): obj((pointer)pobj) {}
+    UrlParam(void* pobj): obj((pointer)pobj) {}
 
-    friend std::ostream& operator<<(std::ostream& os, PostParam<T, Key, Args...>& o)
+    friend std::ostream& operator<<(std::ostream& os, UrlParam<T, Key, Args...>& o)
     {
       if (o.obj)
         os << *o;
@@ -393,9 +1518,14 @@ namespace Restful
     }
   };
 
-  template<typename T, typename... Args>
-  struct PostBody
+  /**
+   * @brief Named variable of a route pattern, e.g. PathVar<int, "id"> for RegisterRestful<"/user/{id:int}">(...)
+   */
+  template<typename T, details::string_literal Key, typename... Args>
+  struct PathVar
   {
+    constexpr static details::string_literal key = Key;
+
     using type      = T;
     using pointer   = T*;
     using reference = T&;
@@ -409,9 +1539,9 @@ namespace Restful
 
     pointer operator->() { return obj; }
 
-    PostBody(void* pobj): obj((pointer)pobj) {}
+    PathVar(void* pobj): obj((pointer)pobj) {}
 
-    friend std::ostream& operator<<(std::ostream& os, PostBody<T, Args...>& o)
+    friend std::ostream& operator<<(std::ostream& os, PathVar<T, Key, Args...>& o)
     {
       if (o.obj)
         os << *o;
@@ -428,414 +1558,6261 @@ namespace Restful
     }
   };
 
-  namespace ArgConvertors
+  /**
+   * @brief Request cookie, e.g. CookieParam<std::string, "session">
+   */
+  template<typename T, details::string_literal Key, typename... Args>
+  struct CookieParam
   {
-    using Convertor_t = std::function<bool(void*&, Ctx&, int)>;
-    using Cleaner_t   = void (*)(void*);
+    constexpr static details::string_literal key = Key;
 
-    // [[ ******************** Base Convertor ********************
-    template<typename T>
-    inline void* base_convertor(const std::string_view& src)
-    {
-      throw std::logic_error("Unsupport convetor");
-    }
+    using type      = T;
+    using pointer   = T*;
+    using reference = T&;
 
-    template<>
-    inline void* base_convertor<char>(const std::string_view& src)
-    {
-      return src.empty() ? nullptr : new char(src[0]);
-    }
+    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
+    pointer               obj;
 
-    template<>
-    inline void* base_convertor<unsigned char>(const std::string_view& src)
+    operator bool() const { return obj != nullptr; }
+
+    reference operator*() { return *obj; }
+
+    pointer operator->() { return obj; }
+
+    CookieParam(void* pobj): obj((pointer)pobj) {}
+
+    friend std::ostream& operator<<(std::ostream& os, CookieParam<T, Key, Args...>& o)
     {
-      return src.empty() ? nullptr : new unsigned char(src[0]);
+      if (o.obj)
+        os << *o;
+      return os;
     }
 
-#define REST_MAKE_BASE_CONVERTOR(Type)                                                                                 \
-  template<>                                                                                                           \
-  inline void* base_convertor<Type>(const std::string_view& src)                                                       \
-  {                                                                                                                    \
-    if (src.empty())                                                                                                   \
-      return nullptr;                                                                                                  \
-    auto ret = std::make_unique<Type>();                                                                               \
-    auto ec  = std::from_chars(src.data(), src.data() + src.size(), *ret).ec;                                          \
-    return (ec == std::errc()) ? (void*)ret.release() : nullptr;                                                       \
+    static T* MakeDefaultValue()
+    {
+      using type = typename details::get_default_value<T, std::tuple<Args...>>::type;
+      if constexpr (std::is_same_v<type, void>)
+        return nullptr;
+      else
+        return new T(type::get_default_value());
+    }
+  };
+
+  /**
+   * @brief Request header, matched case-insensitively, e.g. HeaderParam<std::string, "X-Request-Id">
+   */
+  template<typename T, details::string_literal Key, typename... Args>
+  struct HeaderParam
+  {
+    constexpr static details::string_literal key = Key;
+
+    using type      = T;
+    using pointer   = T*;
+    using reference = T&;
+
+    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
+    pointer               obj;
+
+    operator bool() const { return obj != nullptr; }
+
+    reference operator*() { return *obj; }
+
+    pointer operator->() { return obj; }
+
+    HeaderParam(void* pobj): obj((pointer)pobj) {}
+
+    friend std::ostream& operator<<(std::ostream& os, HeaderParam<T, Key, Args...>& o)
+    {
+      if (o.obj)
+        os << *o;
+      return os;
+    }
+
+    static T* MakeDefaultValue()
+    {
+      using type = typename details::get_default_value<T, std::tuple<Args...>>::type;
+      if constexpr (std::is_same_v<type, void>)
+        return nullptr;
+      else
+        return new T(type::get_default_value());
+    }
+  };
+
+  template<typename T, details::string_literal Key, typename... Args>
+  struct PostParam
+  {
+    constexpr static details::string_literal key = Key;
+
+    using type      = T;
+    using pointer   = T*;
+    using reference = T&;
+
+    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
+    pointer               obj;
+
+    operator bool() const { return obj != nullptr; }
+
+    reference operator*() { return *obj; }
+
+    pointer operator->() { return obj; }
+
+    PostParam(void* pobj): obj((pointer)pobj) {}
+
+    friend std::ostream& operator<<(std::ostream& os, PostParam<T, Key, Args...>& o)
+    {
+      if (o.obj)
+        os << *o;
+      return os;
+    }
+
+    static T* MakeDefaultValue()
+    {
+      using type = typename details::get_default_value<T, std::tuple<Args...>>::type;
+      if constexpr (std::is_same_v<type, void>)
+        return nullptr;
+      else
+        return new T(type::get_default_value());
+    }
+  };
+
+  template<typename T, typename... Args>
+  struct PostBody
+  {
+    using type      = T;
+    using pointer   = T*;
+    using reference = T&;
+
+    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
+    pointer               obj;
+
+    operator bool() const { return obj != nullptr; }
+
+    reference operator*() { return *obj; }
+
+    pointer operator->() { return obj; }
+
+    PostBody(void* pobj): obj((pointer)pobj) {}
+
+    friend std::ostream& operator<<(std::ostream& os, PostBody<T, Args...>& o)
+    {
+      if (o.obj)
+        os << *o;
+      return os;
+    }
+
+    static T* MakeDefaultValue()
+    {
+      using type = typename details::get_default_value<T, std::tuple<Args...>>::type;
+      if constexpr (std::is_same_v<type, void>)
+        return nullptr;
+      else
+        return new T(type::get_default_value());
+    }
+  };
+
+  /**
+   * @brief Field declaration of an aggregate bound by UrlParams / PostParams, tags as for UrlParam
+   *
+   * @example
+    struct Query
+    {
+      int                      page = 1;
+      std::string              q;
+      std::vector<int>         ids;
+      using fields = std::tuple<Field<"page", &Query::page>, Field<"q", &Query::q, Require>, Field<"ids", &Query::ids>>;
+    };
+   */
+  template<details::string_literal Key, auto Member, typename... Args>
+  struct Field
+  {
+    constexpr static details::string_literal key    = Key;
+    constexpr static auto                    member = Member;
+
+    using type       = typename details::member_type<decltype(Member)>::type;
+    using class_type = typename details::member_type<decltype(Member)>::class_type;
+
+    static constexpr bool   isRequire = (std::is_same<Args, Require>::value || ...);
+    static constexpr size_t maxCount  = details::max_count<Args...>();
+
+    // Range, MaxLength and OneOf tags, checked on a bound field
+    static bool Satisfies(const class_type& obj) { return details::satisfies<type, Args...>(obj.*Member); }
+
+    // Missing optional field, keeps the member initializer unless a DefaultValue tag is given
+    static void SetDefaultValue(class_type& obj)
+    {
+      using default_type = typename details::get_default_value<type, std::tuple<Args...>>::type;
+      if constexpr (!std::is_same_v<default_type, void>)
+        obj.*Member = default_type::get_default_value();
+    }
+  };
+
+  /**
+   * @brief The whole query string bound to an aggregate declaring its fields, in one pass
+   */
+  template<typename T, typename... Args>
+  struct UrlParams
+  {
+    using type      = T;
+    using pointer   = T*;
+    using reference = T&;
+
+    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
+    pointer               obj;
+
+    operator bool() const { return obj != nullptr; }
+
+    reference operator*() { return *obj; }
+
+    pointer operator->() { return obj; }
+
+    UrlParams(void* pobj): obj((pointer)pobj) {}
+
+    static T* MakeDefaultValue()
+    {
+      using type = typename details::get_default_value<T, std::tuple<Args...>>::type;
+      if constexpr (std::is_same_v<type, void>)
+        return nullptr;
+      else
+        return new T(type::get_default_value());
+    }
+  };
+
+  /**
+   * @brief The whole form body bound to an aggregate declaring its fields, in one pass
+   */
+  template<typename T, typename... Args>
+  struct PostParams
+  {
+    using type      = T;
+    using pointer   = T*;
+    using reference = T&;
+
+    static constexpr bool isRequire = (std::is_same<Args, Require>::value || ...);
+    pointer               obj;
+
+    operator bool() const { return obj != nullptr; }
+
+    reference operator*() { return *obj; }
+
+    pointer operator->() { return obj; }
+
+    PostParams(void* pobj): obj((pointer)pobj) {}
+
+    static T* MakeDefaultValue()
+    {
+      using type = typename details::get_default_value<T, std::tuple<Args...>>::type;
+      if constexpr (std::is_same_v<type, void>)
+        return nullptr;
+      else
+        return new T(type::get_default_value());
+    }
+  };
+
+  /**
+   * @brief Body encodings of aggregates declaring their fields, see Field
+   * @brief The request format follows Content-Type, the response format follows Accept, JSON when neither names another
+   */
+  enum class BodyFormat : std::uint8_t
+  {
+    Json,
+    MsgPack,
+    Cbor,
+  };
+
+  inline constexpr std::string_view MediaType(BodyFormat format)
+  {
+    constexpr std::string_view types[] = {"application/json", "application/msgpack", "application/cbor"};
+    return types[static_cast<size_t>(format)];
   }
 
-    REST_MAKE_BASE_CONVERTOR(short);
-    REST_MAKE_BASE_CONVERTOR(int);
-    REST_MAKE_BASE_CONVERTOR(long);
-    REST_MAKE_BASE_CONVERTOR(long long);
-    REST_MAKE_BASE_CONVERTOR(unsigned short);
-    REST_MAKE_BASE_CONVERTOR(unsigned int);
-    REST_MAKE_BASE_CONVERTOR(unsigned long);
-    REST_MAKE_BASE_CONVERTOR(unsigned long long);
-    REST_MAKE_BASE_CONVERTOR(float);
-    REST_MAKE_BASE_CONVERTOR(double);
-    REST_MAKE_BASE_CONVERTOR(long double);
+  namespace details
+  {
+    // Media type without parameters, case-insensitive
+    inline std::optional<BodyFormat> body_format_of(std::string_view type)
+    {
+      type = type.substr(0, type.find(';'));
+      while (!type.empty() && (type.front() == ' ' || type.front() == '\t'))
+        type.remove_prefix(1);
+      while (!type.empty() && (type.back() == ' ' || type.back() == '\t'))
+        type.remove_suffix(1);
+
+      auto is = [type](std::string_view name)
+      {
+        return type.size() == name.size() &&
+               std::equal(type.begin(), type.end(), name.begin(), [](char a, char b) { return to_lower(a) == b; });
+      };
+      if (is("application/json") || is("text/json"))
+        return BodyFormat::Json;
+      if (is("application/msgpack") || is("application/x-msgpack") || is("application/vnd.msgpack"))
+        return BodyFormat::MsgPack;
+      if (is("application/cbor"))
+        return BodyFormat::Cbor;
+      return std::nullopt;
+    }
+
+    // Nesting limit of decoded values
+    inline constexpr int maxBodyDepth = 64;
+
+    template<typename T>
+    concept has_body_codec = has_fields<T> || (is_vector<T>::value && has_fields<typename T::value_type>);
+
+    template<typename E>
+    inline std::string_view enum_name_of(E value)
+    {
+      for (auto& e: enum_names<E>.names)
+        if (e.value == value)
+          return e.name;
+      return {};
+    }
+
+    template<typename T>
+    inline constexpr bool always_false = false;
+
+    inline void put_be(std::string& out, std::uint64_t v, int bytes)
+    {
+      char buf[8];
+      for (int i = bytes - 1; i >= 0; --i, v >>= 8)
+        buf[i] = char(v & 0xFF);
+      out.append(buf, bytes);
+    }
+
+    /**
+     * @brief Cursor over a binary body, big endian reads bounded by the end
+     */
+    struct byte_cursor
+    {
+      const std::uint8_t* p;
+      const std::uint8_t* end;
+
+      bool          empty() const { return p == end; }
+      size_t        remaining() const { return end - p; }
+      std::uint8_t  peek() const { return *p; }
+      std::uint8_t  byte() { return *p++; }
+      bool          be(int bytes, std::uint64_t& v)
+      {
+        if (remaining() < size_t(bytes))
+          return false;
+        v = 0;
+        for (int i = 0; i < bytes; ++i)
+          v = (v << 8) | *p++;
+        return true;
+      }
+      bool take(std::uint64_t n, std::string_view& out)
+      {
+        if (remaining() < n)
+          return false;
+        out = std::string_view(reinterpret_cast<const char*>(p), n);
+        p += n;
+        return true;
+      }
+    };
+
+    // [[ ******************** MessagePack ********************
+    struct msgpack_writer
+    {
+      std::string& out;
+
+      void null() { out += char(0xC0); }
+      void boolean(bool v) { out += char(v ? 0xC3 : 0xC2); }
+      void uinteger(std::uint64_t v)
+      {
+        if (v < 0x80)
+          out += char(v);
+        else if (v <= 0xFF)
+          out += char(0xCC), put_be(out, v, 1);
+        else if (v <= 0xFFFF)
+          out += char(0xCD), put_be(out, v, 2);
+        else if (v <= 0xFFFFFFFF)
+          out += char(0xCE), put_be(out, v, 4);
+        else
+          out += char(0xCF), put_be(out, v, 8);
+      }
+      void integer(std::int64_t v)
+      {
+        if (v >= 0)
+          uinteger(std::uint64_t(v));
+        else if (v >= -32)
+          out += char(v);
+        else if (v >= -128)
+          out += char(0xD0), put_be(out, std::uint64_t(v), 1);
+        else if (v >= -32768)
+          out += char(0xD1), put_be(out, std::uint64_t(v), 2);
+        else if (v >= std::numeric_limits<std::int32_t>::min())
+          out += char(0xD2), put_be(out, std::uint64_t(v), 4);
+        else
+          out += char(0xD3), put_be(out, std::uint64_t(v), 8);
+      }
+      void number(double v) { out += char(0xCB), put_be(out, std::bit_cast<std::uint64_t>(v), 8); }
+      void string(std::string_view s)
+      {
+        if (s.size() < 32)
+          out += char(0xA0 | s.size());
+        else if (s.size() <= 0xFF)
+          out += char(0xD9), put_be(out, s.size(), 1);
+        else if (s.size() <= 0xFFFF)
+          out += char(0xDA), put_be(out, s.size(), 2);
+        else
+          out += char(0xDB), put_be(out, s.size(), 4);
+        out += s;
+      }
+      void container(std::uint8_t fix, std::uint8_t c16, size_t n)
+      {
+        if (n < 16)
+          out += char(fix | n);
+        else if (n <= 0xFFFF)
+          out += char(c16), put_be(out, n, 2);
+        else
+          out += char(c16 + 1), put_be(out, n, 4);
+      }
+      void begin_array(size_t n) { container(0x90, 0xDC, n); }
+      void end_array() {}
+      void begin_map(size_t n) { container(0x80, 0xDE, n); }
+      void key(std::string_view k) { string(k); }
+      void end_map() {}
+    };
+
+    struct msgpack_reader
+    {
+      byte_cursor in;
+      int         depth    = 0;
+      bool        rejected = false;
+
+      bool null()
+      {
+        if (in.empty() || in.peek() != 0xC0)
+          return false;
+        in.byte();
+        return true;
+      }
+      bool boolean(bool& v)
+      {
+        if (in.empty() || (in.peek() | 1) != 0xC3)
+          return false;
+        v = in.byte() == 0xC3;
+        return true;
+      }
+      // Any integer encoding, as two's complement bits plus sign
+      bool integer(std::uint64_t& bits, bool& negative)
+      {
+        if (in.empty())
+          return false;
+        std::uint8_t t = in.byte();
+        negative       = false;
+        if (t < 0x80)
+          return bits = t, true;
+        if (t >= 0xE0)
+          return bits = std::uint64_t(std::int64_t(std::int8_t(t))), negative = true, true;
+        if (t >= 0xCC && t <= 0xCF)
+          return in.be(1 << (t - 0xCC), bits);
+        if (t >= 0xD0 && t <= 0xD3)
+        {
+          int bytes = 1 << (t - 0xD0);
+          if (!in.be(bytes, bits))
+            return false;
+          // Sign extend
+          int shift = 64 - bytes * 8;
+          bits      = std::uint64_t((std::int64_t(bits << shift)) >> shift);
+          negative  = std::int64_t(bits) < 0;
+          return true;
+        }
+        --in.p;
+        return false;
+      }
+      bool number(double& v)
+      {
+        if (in.empty())
+          return false;
+        std::uint64_t bits;
+        if (in.peek() == 0xCB)
+          return in.byte(), in.be(8, bits) && (v = std::bit_cast<double>(bits), true);
+        if (in.peek() == 0xCA)
+          return in.byte(), in.be(4, bits) && (v = std::bit_cast<float>(std::uint32_t(bits)), true);
+        bool negative;
+        if (!integer(bits, negative))
+          return false;
+        v = negative ? double(std::int64_t(bits)) : double(bits);
+        return true;
+      }
+      bool string(std::string_view& v)
+      {
+        if (in.empty())
+          return false;
+        std::uint8_t  t = in.byte();
+        std::uint64_t n;
+        if ((t & 0xE0) == 0xA0)
+          n = t & 0x1F;
+        else if (t >= 0xD9 && t <= 0xDB)
+        {
+          if (!in.be(1 << (t - 0xD9), n))
+            return false;
+        }
+        else if (t >= 0xC4 && t <= 0xC6) // bin
+        {
+          if (!in.be(1 << (t - 0xC4), n))
+            return false;
+        }
+        else
+          return --in.p, false;
+        return in.take(n, v);
+      }
+      bool string(std::string& v)
+      {
+        std::string_view s;
+        return string(s) && (v.assign(s), true);
+      }
+      bool header(std::uint8_t fix, std::uint8_t c16, std::uint64_t& n)
+      {
+        if (in.empty())
+          return false;
+        std::uint8_t t = in.peek();
+        if ((t & 0xF0) == fix)
+          return in.byte(), n = t & 0x0F, true;
+        if (t == c16 || t == c16 + 1)
+          return in.byte(), in.be(t == c16 ? 2 : 4, n);
+        return false;
+      }
+      template<typename F>
+      bool array(F&& each)
+      {
+        std::uint64_t n;
+        if (depth == maxBodyDepth || !header(0x90, 0xDC, n) || n > in.remaining())
+          return false;
+        ++depth;
+        while (n--)
+          if (!each())
+            return false;
+        --depth;
+        return true;
+      }
+      template<typename F>
+      bool map(F&& each)
+      {
+        std::uint64_t n;
+        if (depth == maxBodyDepth || !header(0x80, 0xDE, n) || n > in.remaining())
+          return false;
+        ++depth;
+        std::string_view key;
+        while (n--)
+          if (!string(key) || !each(key))
+            return false;
+        --depth;
+        return true;
+      }
+      bool skip()
+      {
+        if (in.empty() || depth == maxBodyDepth)
+          return false;
+        std::uint8_t     t = in.peek();
+        std::uint64_t    n, bits;
+        bool             negative;
+        double           d;
+        std::string_view s;
+        if (t == 0xC0 || t == 0xC2 || t == 0xC3)
+          return in.byte(), true;
+        if (integer(bits, negative) || number(d) || string(s))
+          return true;
+        if (header(0x90, 0xDC, n))
+        {
+          ++depth;
+          for (; n; --n)
+            if (!skip())
+              return false;
+          --depth;
+          return true;
+        }
+        if (header(0x80, 0xDE, n))
+        {
+          ++depth;
+          for (; n; --n)
+            if (!skip() || !skip())
+              return false;
+          --depth;
+          return true;
+        }
+        // fixext 1..16 and ext 8/16/32, a type byte then the data
+        in.byte();
+        if (t >= 0xD4 && t <= 0xD8)
+          return in.take(1 + (1 << (t - 0xD4)), s);
+        if (t >= 0xC7 && t <= 0xC9)
+          return in.be(1 << (t - 0xC7), n) && in.take(n + 1, s);
+        return false;
+      }
+    };
+    // ]] ******************** MessagePack ********************
+
+    // [[ ******************** CBOR ********************
+    struct cbor_writer
+    {
+      std::string& out;
+
+      void head(std::uint8_t major, std::uint64_t v)
+      {
+        major <<= 5;
+        if (v < 24)
+          out += char(major | v);
+        else if (v <= 0xFF)
+          out += char(major | 24), put_be(out, v, 1);
+        else if (v <= 0xFFFF)
+          out += char(major | 25), put_be(out, v, 2);
+        else if (v <= 0xFFFFFFFF)
+          out += char(major | 26), put_be(out, v, 4);
+        else
+          out += char(major | 27), put_be(out, v, 8);
+      }
+      void null() { out += char(0xF6); }
+      void boolean(bool v) { out += char(v ? 0xF5 : 0xF4); }
+      void uinteger(std::uint64_t v) { head(0, v); }
+      void integer(std::int64_t v) { v >= 0 ? head(0, std::uint64_t(v)) : head(1, std::uint64_t(-1 - v)); }
+      void number(double v) { out += char(0xFB), put_be(out, std::bit_cast<std::uint64_t>(v), 8); }
+      void string(std::string_view s)
+      {
+        head(3, s.size());
+        out += s;
+      }
+      void begin_array(size_t n) { head(4, n); }
+      void end_array() {}
+      void begin_map(size_t n) { head(5, n); }
+      void key(std::string_view k) { string(k); }
+      void end_map() {}
+    };
+
+    struct cbor_reader
+    {
+      byte_cursor in;
+      int         depth    = 0;
+      bool        rejected = false;
+
+      // Major type and argument of the next item, tags are skipped, p is left on the item on failure
+      bool head(std::uint8_t& major, std::uint64_t& arg, bool& indefinite)
+      {
+        const std::uint8_t* start = in.p;
+        for (;;)
+        {
+          if (in.empty())
+            break;
+          std::uint8_t t = in.byte();
+          major          = t >> 5;
+          std::uint8_t a = t & 0x1F;
+          indefinite     = false;
+          if (a < 24)
+            arg = a;
+          else if (a <= 27)
+          {
+            if (!in.be(1 << (a - 24), arg))
+              break;
+          }
+          else if (a == 31 && major >= 2 && major <= 5)
+            arg = 0, indefinite = true;
+          else
+            break;
+          if (major != 6)
+            return true;
+        }
+        in.p = start;
+        return false;
+      }
+      bool expect(std::uint8_t want, std::uint64_t& arg, bool& indefinite)
+      {
+        const std::uint8_t* start = in.p;
+        std::uint8_t        major;
+        if (head(major, arg, indefinite) && major == want)
+          return true;
+        in.p = start;
+        return false;
+      }
+
+      bool null()
+      {
+        // null or undefined
+        if (in.empty() || (in.peek() | 1) != 0xF7)
+          return false;
+        in.byte();
+        return true;
+      }
+      bool boolean(bool& v)
+      {
+        if (in.empty() || (in.peek() | 1) != 0xF5)
+          return false;
+        v = in.byte() == 0xF5;
+        return true;
+      }
+      bool integer(std::uint64_t& bits, bool& negative)
+      {
+        const std::uint8_t* start = in.p;
+        std::uint8_t        major;
+        bool                indefinite;
+        if (!head(major, bits, indefinite) || major > 1)
+          return in.p = start, false;
+        negative = major == 1;
+        // -1 - n, n beyond int64 is out of range of every target
+        if (negative)
+        {
+          if (bits > std::uint64_t(std::numeric_limits<std::int64_t>::max()))
+            return in.p = start, false;
+          bits = std::uint64_t(-1 - std::int64_t(bits));
+        }
+        return true;
+      }
+      bool number(double& v)
+      {
+        const std::uint8_t* start = in.p;
+        std::uint64_t       arg;
+        if (!in.empty() && (in.peek() >> 5) == 7)
+        {
+          std::uint8_t a = in.byte() & 0x1F;
+          if (a == 25 && in.be(2, arg))
+          {
+            // IEEE 754 half precision
+            int    exp  = (arg >> 10) & 0x1F;
+            int    mant = arg & 0x3FF;
+            double m    = exp == 0 ? std::ldexp(mant, -24)
+                          : exp == 31 ? (mant ? std::numeric_limits<double>::quiet_NaN()
+                                              : std::numeric_limits<double>::infinity())
+                                      : std::ldexp(mant + 1024, exp - 25);
+            return v = (arg & 0x8000) ? -m : m, true;
+          }
+          if (a == 26 && in.be(4, arg))
+            return v = std::bit_cast<float>(std::uint32_t(arg)), true;
+          if (a == 27 && in.be(8, arg))
+            return v = std::bit_cast<double>(arg), true;
+          return in.p = start, false;
+        }
+        bool negative;
+        if (!integer(arg, negative))
+          return false;
+        v = negative ? double(std::int64_t(arg)) : double(arg);
+        return true;
+      }
+      // Definite text or byte strings
+      bool string(std::string_view& v)
+      {
+        const std::uint8_t* start = in.p;
+        std::uint8_t        major;
+        std::uint64_t       n;
+        bool                indefinite;
+        if (head(major, n, indefinite) && (major == 2 || major == 3) && !indefinite && in.take(n, v))
+          return true;
+        in.p = start;
+        return false;
+      }
+      bool string(std::string& v)
+      {
+        std::string_view s;
+        return string(s) && (v.assign(s), true);
+      }
+      bool at_break()
+      {
+        if (!in.empty() && in.peek() == 0xFF)
+          return in.byte(), true;
+        return false;
+      }
+      template<typename F>
+      bool items(std::uint8_t major, F&& each)
+      {
+        std::uint64_t n;
+        bool          indefinite;
+        if (depth == maxBodyDepth || !expect(major, n, indefinite) || (!indefinite && n > in.remaining()))
+          return false;
+        ++depth;
+        if (indefinite)
+        {
+          while (!at_break())
+            if (in.empty() || !each())
+              return false;
+        }
+        else
+          while (n--)
+            if (!each())
+              return false;
+        --depth;
+        return true;
+      }
+      template<typename F>
+      bool array(F&& each)
+      {
+        return items(4, each);
+      }
+      template<typename F>
+      bool map(F&& each)
+      {
+        std::string_view key;
+        return items(5, [&] { return string(key) && each(key); });
+      }
+      bool skip()
+      {
+        std::uint8_t     major;
+        std::uint64_t    n;
+        bool             indefinite;
+        std::string_view s;
+        if (depth == maxBodyDepth || !head(major, n, indefinite))
+          return false;
+        switch (major)
+        {
+          case 0:
+          case 1:
+          case 7:
+            // Simple values and floats carry their payload in the argument
+            return true;
+          case 2:
+          case 3:
+            if (!indefinite)
+              return in.take(n, s);
+            [[fallthrough]];
+          default:
+          {
+            // Indefinite strings are a sequence of chunks, containers hold n items or n pairs
+            if (!indefinite && n > in.remaining())
+              return false;
+            ++depth;
+            std::uint64_t count = major == 5 ? n * 2 : n;
+            for (; indefinite ? !at_break() : count > 0; --count)
+              if (in.empty() || !skip())
+                return false;
+            --depth;
+            return true;
+          }
+        }
+      }
+    };
+    // ]] ******************** CBOR ********************
+
+    // [[ ******************** JSON ********************
+    /**
+     * @brief Output of json_writer appending to a string
+     */
+    struct string_sink
+    {
+      std::string& out;
+
+      void  put(char c) { out += c; }
+      void  write(const char* p, size_t n) { out.append(p, n); }
+      char& last() { return out.back(); }
+      void  pop() { out.pop_back(); }
+      // Room for n bytes, commit() gives back what was not used
+      char* reserve(size_t n)
+      {
+        size_t size = out.size();
+        out.resize(size + n);
+        return out.data() + size;
+      }
+      void commit(char* end) { out.resize(end - out.data()); }
+    };
+
+    /**
+     * @brief Thread local free list behind allocate_shared, a BodyChunk and its control block are one pooled block
+     */
+    template<typename T>
+    struct chunk_allocator
+    {
+      using value_type = T;
+
+      static constexpr size_t maxCached = 64;
+
+      chunk_allocator() = default;
+      template<typename U>
+      chunk_allocator(const chunk_allocator<U>&)
+      {
+      }
+
+      struct free_list
+      {
+        std::vector<void*> blocks;
+        ~free_list()
+        {
+          alive = false;
+          for (void* block: blocks)
+            ::operator delete(block);
+        }
+      };
+      // Blocks released during thread exit go back to the heap
+      static inline thread_local bool alive = true;
+
+      static free_list& blocks()
+      {
+        static thread_local free_list list;
+        return list;
+      }
+
+      T* allocate(size_t n)
+      {
+        if (n == 1 && alive && !blocks().blocks.empty())
+        {
+          void* block = blocks().blocks.back();
+          blocks().blocks.pop_back();
+          return static_cast<T*>(block);
+        }
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+      }
+
+      void deallocate(T* p, size_t n)
+      {
+        if (n == 1 && alive && blocks().blocks.size() < maxCached)
+          blocks().blocks.push_back(p);
+        else
+          ::operator delete(p);
+      }
+
+      friend bool operator==(const chunk_allocator&, const chunk_allocator&) { return true; }
+    };
+
+    /**
+     * @brief Output of json_writer filling pooled chunks, a full chunk is kept as is and the next one is started
+     */
+    class chunk_sink
+    {
+    public:
+      void put(char c)
+      {
+        if (!cur || cur->size == BodyChunk::capacity)
+          grow();
+        cur->data[cur->size++] = c;
+      }
+      void write(const char* p, size_t n)
+      {
+        while (n)
+        {
+          if (!cur || cur->size == BodyChunk::capacity)
+            grow();
+          size_t take = std::min(n, BodyChunk::capacity - cur->size);
+          std::memcpy(cur->data + cur->size, p, take);
+          cur->size += take;
+          p += take;
+          n -= take;
+        }
+      }
+      char& last()
+      {
+        BodyChunk* chunk = cur->size ? cur : chunks[chunks.size() - 2].get();
+        return chunk->data[chunk->size - 1];
+      }
+      void pop()
+      {
+        BodyChunk* chunk = cur->size ? cur : chunks[chunks.size() - 2].get();
+        --chunk->size;
+      }
+      char* reserve(size_t n)
+      {
+        if (!cur || BodyChunk::capacity - cur->size < n)
+          grow();
+        return cur->data + cur->size;
+      }
+      void commit(char* end) { cur->size = end - cur->data; }
+
+      size_t size() const
+      {
+        size_t total = 0;
+        for (auto& chunk: chunks)
+          total += chunk->size;
+        return total;
+      }
+
+      std::vector<std::shared_ptr<const BodyChunk>> take()
+      {
+        std::vector<std::shared_ptr<const BodyChunk>> out(chunks.begin(), chunks.end());
+        if (!out.empty() && !out.back()->size)
+          out.pop_back();
+        chunks.clear();
+        cur = nullptr;
+        return out;
+      }
+
+    private:
+      void grow()
+      {
+        chunks.push_back(std::allocate_shared<BodyChunk>(chunk_allocator<BodyChunk>()));
+        cur = chunks.back().get();
+      }
+
+      std::vector<std::shared_ptr<BodyChunk>> chunks;
+      BodyChunk*                              cur = nullptr;
+    };
+
+    template<typename Out>
+    struct json_writer
+    {
+      Out& out;
+
+      void append(std::string_view s) { out.write(s.data(), s.size()); }
+
+      // Every value is followed by ',', closing a container replaces the last one
+      void close(char c)
+      {
+        if (out.last() == ',')
+          out.last() = c;
+        else
+          out.put(c);
+        out.put(',');
+      }
+      void null() { append("null,"); }
+      void boolean(bool v) { append(v ? "true," : "false,"); }
+      template<typename T>
+      void format(T v)
+      {
+        // Shortest round-trip form, written in place
+        char* p   = out.reserve(32);
+        char* end = std::to_chars(p, p + 31, v).ptr;
+        *end++    = ',';
+        out.commit(end);
+      }
+      void uinteger(std::uint64_t v) { format(v); }
+      void integer(std::int64_t v) { format(v); }
+      void number(double v) { std::isfinite(v) ? format(v) : null(); }
+      void quoted(std::string_view s)
+      {
+        static constexpr char hex[] = "0123456789abcdef";
+        out.put('"');
+        const char* p   = s.data();
+        const char* end = p + s.size();
+        for (;;)
+        {
+          const char* esc = find_json_escape(p, end);
+          out.write(p, esc - p);
+          if (esc == end)
+            break;
+          unsigned char c = *esc;
+          p               = esc + 1;
+          switch (c)
+          {
+            case '"': append("\\\""); break;
+            case '\\': append("\\\\"); break;
+            case '\n': append("\\n"); break;
+            case '\r': append("\\r"); break;
+            case '\t': append("\\t"); break;
+            default:
+            {
+              char u[6] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xF]};
+              out.write(u, 6);
+            }
+          }
+        }
+        out.put('"');
+      }
+      void string(std::string_view s)
+      {
+        quoted(s);
+        out.put(',');
+      }
+      void begin_array(size_t) { out.put('['); }
+      void end_array() { close(']'); }
+      void begin_map(size_t) { out.put('{'); }
+      void key(std::string_view k)
+      {
+        quoted(k);
+        out.put(':');
+      }
+      void end_map() { close('}'); }
+    };
+
+    struct json_reader
+    {
+      const char* p;
+      const char* end;
+      int         depth    = 0;
+      bool        rejected = false;
+      // Unescaped key, when the key had escapes
+      std::string scratch;
+
+      void ws()
+      {
+        while (p != end && (*p == ' ' || *p == '\t' || *p == '\n' || *p == '\r'))
+          ++p;
+      }
+      bool literal(std::string_view word)
+      {
+        ws();
+        if (size_t(end - p) < word.size() || std::memcmp(p, word.data(), word.size()) != 0)
+          return false;
+        p += word.size();
+        return true;
+      }
+      bool null() { return literal("null"); }
+      bool boolean(bool& v)
+      {
+        if (literal("true"))
+          return v = true, true;
+        if (literal("false"))
+          return v = false, true;
+        return false;
+      }
+      // JSON number with no fraction or exponent
+      bool integer(std::uint64_t& bits, bool& negative)
+      {
+        ws();
+        negative = p != end && *p == '-';
+        if (negative)
+        {
+          std::int64_t v;
+          auto [ptr, ec] = std::from_chars(p, end, v);
+          if (ec != std::errc() || (ptr != end && (*ptr == '.' || *ptr == 'e' || *ptr == 'E')))
+            return false;
+          return bits = std::uint64_t(v), p = ptr, true;
+        }
+        auto [ptr, ec] = std::from_chars(p, end, bits);
+        if (ec != std::errc() || (ptr != end && (*ptr == '.' || *ptr == 'e' || *ptr == 'E')))
+          return false;
+        return p = ptr, true;
+      }
+      bool number(double& v)
+      {
+        ws();
+        // from_chars would also take "inf" and "nan"
+        if (p == end || (*p != '-' && std::uint8_t(*p - '0') > 9))
+          return false;
+        auto [ptr, ec] = std::from_chars(p, end, v);
+        if (ec != std::errc())
+          return false;
+        return p = ptr, true;
+      }
+      static void utf8(std::string& out, std::uint32_t cp)
+      {
+        if (cp < 0x80)
+          out += char(cp);
+        else if (cp < 0x800)
+          out += char(0xC0 | (cp >> 6)), out += char(0x80 | (cp & 0x3F));
+        else if (cp < 0x10000)
+          out += char(0xE0 | (cp >> 12)), out += char(0x80 | ((cp >> 6) & 0x3F)), out += char(0x80 | (cp & 0x3F));
+        else
+          out += char(0xF0 | (cp >> 18)), out += char(0x80 | ((cp >> 12) & 0x3F)),
+              out += char(0x80 | ((cp >> 6) & 0x3F)), out += char(0x80 | (cp & 0x3F));
+      }
+      static bool hex4(const char*& q, const char* e, std::uint32_t& cp)
+      {
+        if (e - q < 4)
+          return false;
+        auto [ptr, ec] = std::from_chars(q, q + 4, cp, 16);
+        if (ec != std::errc() || ptr != q + 4)
+          return false;
+        q += 4;
+        return true;
+      }
+      /**
+       * @brief String at p, raw is the text between the quotes, escaped tells whether it needs unescape()
+       */
+      bool raw_string(std::string_view& raw, bool& escaped)
+      {
+        ws();
+        if (p == end || *p != '"')
+          return false;
+        const char* begin = ++p;
+        escaped           = false;
+        for (;;)
+        {
+          p = find_either(p, end, '"', '\\');
+          if (p == end)
+            return false;
+          if (*p == '"')
+            break;
+          escaped = true;
+          if (end - p < 2)
+            return false;
+          p += 2;
+        }
+        raw = std::string_view(begin, p++ - begin);
+        return true;
+      }
+      static bool unescape(std::string_view raw, std::string& out)
+      {
+        out.clear();
+        const char* q = raw.data();
+        const char* e = q + raw.size();
+        while (q != e)
+        {
+          const char* slash = find_either(q, e, '\\', '\\');
+          out.append(q, slash);
+          if (slash == e)
+            break;
+          q = slash + 2;
+          switch (slash[1])
+          {
+            case '"': out += '"'; break;
+            case '\\': out += '\\'; break;
+            case '/': out += '/'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'n': out += '\n'; break;
+            case 'r': out += '\r'; break;
+            case 't': out += '\t'; break;
+            case 'u':
+            {
+              std::uint32_t cp;
+              if (!hex4(q, e, cp) || (cp >= 0xDC00 && cp < 0xE000))
+                return false;
+              if (cp >= 0xD800 && cp < 0xDC00)
+              {
+                // Surrogate pair
+                std::uint32_t lo;
+                if (e - q < 2 || q[0] != '\\' || q[1] != 'u' || !hex4(q += 2, e, lo) || lo < 0xDC00 || lo >= 0xE000)
+                  return false;
+                cp = 0x10000 + ((cp - 0xD800) << 10) + (lo - 0xDC00);
+              }
+              utf8(out, cp);
+              break;
+            }
+            default: return false;
+          }
+        }
+        return true;
+      }
+      bool string(std::string& v)
+      {
+        std::string_view raw;
+        bool             escaped;
+        if (!raw_string(raw, escaped))
+          return false;
+        if (!escaped)
+          return v.assign(raw), true;
+        return unescape(raw, v);
+      }
+      // Views into the body, only for strings without escapes
+      bool string(std::string_view& v)
+      {
+        bool escaped;
+        return raw_string(v, escaped) && !escaped;
+      }
+      bool punct(char c)
+      {
+        ws();
+        if (p == end || *p != c)
+          return false;
+        ++p;
+        return true;
+      }
+      template<typename F>
+      bool array(F&& each)
+      {
+        if (depth == maxBodyDepth || !punct('['))
+          return false;
+        ++depth;
+        if (!punct(']'))
+        {
+          do
+            if (!each())
+              return false;
+          while (punct(','));
+          if (!punct(']'))
+            return false;
+        }
+        --depth;
+        return true;
+      }
+      template<typename F>
+      bool map(F&& each)
+      {
+        if (depth == maxBodyDepth || !punct('{'))
+          return false;
+        ++depth;
+        if (!punct('}'))
+        {
+          do
+          {
+            std::string_view key;
+            bool             escaped;
+            if (!raw_string(key, escaped) || !punct(':'))
+              return false;
+            if (escaped)
+            {
+              if (!unescape(key, scratch))
+                return false;
+              key = scratch;
+            }
+            if (!each(key))
+              return false;
+          } while (punct(','));
+          if (!punct('}'))
+            return false;
+        }
+        --depth;
+        return true;
+      }
+      bool skip()
+      {
+        ws();
+        if (p == end)
+          return false;
+        std::string_view s;
+        bool             b;
+        double           d;
+        switch (*p)
+        {
+          case '"': return raw_string(s, b);
+          case '[': return array([this] { return skip(); });
+          case '{': return map([this](std::string_view) { return skip(); });
+          case 't':
+          case 'f': return boolean(b);
+          case 'n': return null();
+          default: return number(d);
+        }
+      }
+    };
+    // ]] ******************** JSON ********************
+
+    template<typename W, typename T>
+    inline void encode_value(W& w, const T& v);
+
+    template<typename W, typename T>
+    inline void encode_fields(W& w, const T& obj)
+    {
+      using fields = typename T::fields;
+      w.begin_map(std::tuple_size_v<fields>);
+      [&]<size_t... I>(std::index_sequence<I...>)
+      {
+        ((w.key(std::tuple_element_t<I, fields>::key.view()),
+          encode_value(w, obj.*std::tuple_element_t<I, fields>::member)),
+         ...);
+      }(std::make_index_sequence<std::tuple_size_v<fields>>());
+      w.end_map();
+    }
+
+    /**
+     * @brief Booleans, numbers, strings, vectors, named enums (by name), durations (as a count) and nested aggregates
+     */
+    template<typename W, typename T>
+    inline void encode_value(W& w, const T& v)
+    {
+      if constexpr (std::is_same_v<T, bool>)
+        w.boolean(v);
+      else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>)
+        w.integer(v);
+      else if constexpr (std::is_integral_v<T>)
+        w.uinteger(v);
+      else if constexpr (std::is_floating_point_v<T>)
+        w.number(double(v));
+      else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        w.string(v);
+      else if constexpr (is_vector<T>::value)
+      {
+        w.begin_array(v.size());
+        for (auto& item: v)
+          encode_value(w, item);
+        w.end_array();
+      }
+      else if constexpr (has_fields<T>)
+        encode_fields(w, v);
+      else if constexpr (has_enum_names<T>)
+        w.string(enum_name_of(v));
+      else if constexpr (is_duration<T>::value)
+        encode_value(w, v.count());
+      else
+        static_assert(always_false<T>, "no body encoding for this type");
+    }
+
+    template<typename R, typename T>
+    inline bool decode_value(R& r, T& v, size_t maxCount = defaultMaxCount);
+
+    /**
+     * @brief Bind a map to every declared field of T, tags as for UrlParams
+     * @brief Unknown keys are skipped and the first occurrence of a field wins, a value of the wrong type fails the decode
+     * @return false if malformed or a Require field is missing, or with r.rejected set if a field (at any depth) breaks its Range, MaxLength or OneOf tag
+     */
+    template<typename R, typename T>
+    inline bool decode_fields(R& r, T& obj)
+    {
+      using fields     = typename T::fields;
+      constexpr auto N = std::tuple_size_v<fields>;
+      static_assert(N <= 64, "an aggregate param supports up to 64 fields");
+
+      std::uint64_t found = 0;
+      auto          bind  = [&]<size_t I>(std::string_view key, bool& ok)
+      {
+        using field = std::tuple_element_t<I, fields>;
+        if (key != field::key.view())
+          return false;
+        constexpr std::uint64_t bit = std::uint64_t(1) << I;
+        ok    = (found & bit) ? r.skip() : decode_value(r, obj.*field::member, field::maxCount);
+        found |= bit;
+        return true;
+      };
+
+      bool parsed = r.map(
+          [&](std::string_view key)
+          {
+            bool ok = true;
+            bool matched = [&]<size_t... I>(std::index_sequence<I...>)
+            { return (bind.template operator()<I>(key, ok) || ...); }(std::make_index_sequence<N>());
+            return matched ? ok : r.skip();
+          });
+      if (!parsed)
+        return false;
+
+      return [&]<size_t... I>(std::index_sequence<I...>)
+      {
+        auto check = [&]<size_t J>()
+        {
+          using field = std::tuple_element_t<J, fields>;
+          if (found & (std::uint64_t(1) << J))
+          {
+            if (field::Satisfies(obj))
+              return true;
+            std::cout << "Invalid field: " << field::key.view() << std::endl;
+            r.rejected = true;
+            return false;
+          }
+          if constexpr (field::isRequire)
+          {
+            std::cout << "Require field: " << field::key.view() << std::endl;
+            return false;
+          }
+          field::SetDefaultValue(obj);
+          return true;
+        };
+        return (check.template operator()<I>() && ...);
+      }(std::make_index_sequence<N>());
+    }
+
+    template<typename T>
+    inline bool narrow_integer(std::uint64_t bits, bool negative, T& v)
+    {
+      if constexpr (std::is_signed_v<T>)
+      {
+        std::int64_t s = std::int64_t(bits);
+        if (negative ? s < std::int64_t(std::numeric_limits<T>::min())
+                     : bits > std::uint64_t(std::numeric_limits<T>::max()))
+          return false;
+        v = T(s);
+      }
+      else
+      {
+        if (negative || bits > std::uint64_t(std::numeric_limits<T>::max()))
+          return false;
+        v = T(bits);
+      }
+      return true;
+    }
+
+    template<typename R, typename T>
+    inline bool decode_value(R& r, T& v, size_t maxCount)
+    {
+      if constexpr (std::is_same_v<T, bool>)
+        return r.boolean(v);
+      else if constexpr (std::is_integral_v<T>)
+      {
+        std::uint64_t bits;
+        bool          negative;
+        return r.integer(bits, negative) && narrow_integer(bits, negative, v);
+      }
+      else if constexpr (std::is_floating_point_v<T>)
+      {
+        double d;
+        return r.number(d) && (v = T(d), true);
+      }
+      else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+        return r.string(v);
+      else if constexpr (is_vector<T>::value)
+      {
+        v.clear();
+        return r.array(
+            [&]
+            {
+              if (v.size() == maxCount)
+                return false;
+              return decode_value(r, v.emplace_back());
+            });
+      }
+      else if constexpr (has_fields<T>)
+        return decode_fields(r, v);
+      else if constexpr (has_enum_names<T>)
+      {
+        std::string name;
+        if (!r.string(name))
+          return false;
+        auto e = enum_names<T>.find(name);
+        return e && (v = e->value, true);
+      }
+      else if constexpr (is_duration<T>::value)
+      {
+        typename T::rep count;
+        return decode_value(r, count) && (v = T(count), true);
+      }
+      else
+        static_assert(always_false<T>, "no body decoding for this type");
+    }
+
+    template<typename F>
+    inline auto with_reader(BodyFormat format, std::string_view src, F&& f)
+    {
+      auto bytes = reinterpret_cast<const std::uint8_t*>(src.data());
+      switch (format)
+      {
+        case BodyFormat::MsgPack:
+        {
+          msgpack_reader r{{bytes, bytes + src.size()}};
+          return f(r);
+        }
+        case BodyFormat::Cbor:
+        {
+          cbor_reader r{{bytes, bytes + src.size()}};
+          return f(r);
+        }
+        default:
+        {
+          json_reader r{src.data(), src.data() + src.size()};
+          return f(r);
+        }
+      }
+    }
+  } // namespace details
+
+  /**
+   * @brief Serialize an aggregate declaring its fields (or a vector of them), named enums as names, durations as counts
+   */
+  template<typename T>
+  inline std::string Encode(BodyFormat format, const T& value)
+  {
+    std::string out;
+    switch (format)
+    {
+      case BodyFormat::MsgPack:
+      {
+        details::msgpack_writer w{out};
+        details::encode_value(w, value);
+        break;
+      }
+      case BodyFormat::Cbor:
+      {
+        details::cbor_writer w{out};
+        details::encode_value(w, value);
+        break;
+      }
+      default:
+      {
+        details::string_sink                    sink{out};
+        details::json_writer<details::string_sink> w{sink};
+        details::encode_value(w, value);
+        out.pop_back(); // trailing ','
+      }
+    }
+    return out;
+  }
+
+  /**
+   * @brief Parse src into value, fields follow their Require/DefaultValue/constraint tags, trailing bytes are an error
+   */
+  template<typename T>
+  inline bool Decode(BodyFormat format, std::string_view src, T& value, bool* rejected = nullptr)
+  {
+    return details::with_reader(format, src,
+                                   [&](auto& r)
+                                   {
+                                     bool ok = details::decode_value(r, value);
+                                     if (rejected)
+                                       *rejected = r.rejected;
+                                     if constexpr (std::is_same_v<std::decay_t<decltype(r)>, details::json_reader>)
+                                     {
+                                       r.ws();
+                                       return ok && r.p == r.end;
+                                     }
+                                     else
+                                       return ok && r.in.empty();
+                                   });
+  }
+
+  /**
+   * @brief Streaming JSON writer filling pooled chunks, which become the segments of the response without a final copy
+   * @brief Strings are escaped 16 bytes at a time with SSE2, numbers are formatted in place with std::to_chars
+   *
+   * @example
+    JsonWriter json;
+    json.BeginObject().Key("id").Int(42).Key("order").Value(order).Key("tags").BeginArray();
+    for (auto& tag: tags)
+      json.String(tag);
+    return json.EndArray().EndObject().Finish();
+   */
+  class JsonWriter
+  {
+  public:
+    JsonWriter& Null() { return write([](auto& w) { w.null(); }); }
+    JsonWriter& Bool(bool v) { return write([v](auto& w) { w.boolean(v); }); }
+    JsonWriter& Int(std::int64_t v) { return write([v](auto& w) { w.integer(v); }); }
+    JsonWriter& Uint(std::uint64_t v) { return write([v](auto& w) { w.uinteger(v); }); }
+    JsonWriter& Double(double v) { return write([v](auto& w) { w.number(v); }); }
+    JsonWriter& String(std::string_view v) { return write([v](auto& w) { w.string(v); }); }
+    JsonWriter& Key(std::string_view k) { return write([k](auto& w) { w.key(k); }); }
+    JsonWriter& BeginArray() { return write([](auto& w) { w.begin_array(0); }); }
+    JsonWriter& EndArray() { return write([](auto& w) { w.end_array(); }); }
+    JsonWriter& BeginObject() { return write([](auto& w) { w.begin_map(0); }); }
+    JsonWriter& EndObject() { return write([](auto& w) { w.end_map(); }); }
+
+    // Aggregates declaring their fields, vectors, named enums, durations and scalars, as for Encode
+    template<typename T>
+    JsonWriter& Value(const T& v)
+    {
+      return write([&v](auto& w) { details::encode_value(w, v); });
+    }
+
+    // Bytes written so far, including the separator after the last value
+    size_t Size() const { return sink.size(); }
+
+    /**
+     * @brief Response holding the written chunks, the writer is empty afterwards
+     */
+    Ret Finish(int status = 200)
+    {
+      if (written)
+        sink.pop(); // trailing ','
+      written = false;
+
+      Ret ret{.status = status, .headers = {{"Content-Type", "application/json"}}};
+      ret.chunks = sink.take();
+      return ret;
+    }
+
+  private:
+    template<typename F>
+    JsonWriter& write(F&& f)
+    {
+      details::json_writer<details::chunk_sink> w{sink};
+      f(w);
+      written = true;
+      return *this;
+    }
+
+    details::chunk_sink sink;
+    bool                written = false;
+  };
+
+  /**
+   * @brief Format named by Content-Type, JSON for anything else
+   */
+  inline BodyFormat ContentFormat(const Ctx& ctx)
+  {
+    return details::body_format_of(ctx.GetHeaderLowercase("content-type")).value_or(BodyFormat::Json);
+  }
+
+  /**
+   * @brief First format listed in Accept that can be produced, JSON if none (quality values are not weighed)
+   */
+  inline BodyFormat AcceptedFormat(const Ctx& ctx)
+  {
+    std::string_view accept = ctx.GetHeaderLowercase("accept");
+    while (!accept.empty())
+    {
+      size_t comma = accept.find(',');
+      if (auto format = details::body_format_of(accept.substr(0, comma)))
+        return *format;
+      accept = comma == std::string_view::npos ? std::string_view() : accept.substr(comma + 1);
+    }
+    return BodyFormat::Json;
+  }
+
+  /**
+   * @brief Response with value encoded in the format the client accepts, the counterpart of PostBody<T> for aggregates
+   *
+   * @example
+    apis.RegisterRestful("/order", [](Ctx& ctx, PostBody<Order, Require> order) -> Ret { return Reply(ctx, *order); });
+   */
+  template<typename T>
+  inline Ret Reply(const Ctx& ctx, const T& value, int status = 200)
+  {
+    BodyFormat format = AcceptedFormat(ctx);
+    Ret        ret;
+    if (format == BodyFormat::Json)
+      ret = JsonWriter().Value(value).Finish(status);
+    else
+    {
+      ret = Ret{.status = status, .headers = {{"Content-Type", std::string(MediaType(format))}}};
+      ret.body = Encode(format, value);
+    }
+    ret.headers.emplace_back("Vary", "Accept");
+    return ret;
+  }
+
+  namespace ArgConvertors
+  {
+    using Convertor_t = bool (*)(void*&, Ctx&, int);
+    using Cleaner_t   = void (*)(void*);
+
+    template<typename Result>
+    void clean(void* ptr);
+
+    // [[ ******************** Base Convertor ********************
+    template<typename T>
+    inline void* base_convertor(const std::string_view& src)
+    {
+      if constexpr (details::has_enum_names<T>)
+      {
+        auto e = details::enum_names<T>.find(src);
+        return e ? new T(e->value) : nullptr;
+      }
+      else if constexpr (details::is_duration<T>::value)
+      {
+        // A plain number counts in the units of T
+        typename T::rep count;
+        auto [ptr, ec] = std::from_chars(src.data(), src.data() + src.size(), count);
+        if (!src.empty() && ec == std::errc() && ptr == src.data() + src.size())
+          return new T(count);
+
+        std::chrono::nanoseconds ns;
+        if (!details::parse_duration(src, ns))
+          return nullptr;
+        T value = std::chrono::duration_cast<T>(ns);
+        // Reject what T can not hold exactly, e.g. "500ms" as std::chrono::seconds
+        if constexpr (!std::chrono::treat_as_floating_point_v<typename T::rep>)
+          if (std::chrono::duration_cast<std::chrono::nanoseconds>(value) != ns)
+            return nullptr;
+        return new T(value);
+      }
+      else if constexpr (details::is_sys_time<T>::value)
+      {
+        using D = typename T::duration;
+        std::chrono::sys_seconds s;
+        std::chrono::nanoseconds fraction;
+        if (!details::parse_date_time(src, s, fraction))
+          return nullptr;
+        // Sub-second units count a shorter span than 0000..9999
+        if constexpr (std::ratio_less_v<typename D::period, std::ratio<1>>)
+        {
+          auto limit = std::chrono::duration_cast<std::chrono::seconds>(D::max()) - std::chrono::seconds(1);
+          if (s.time_since_epoch() > limit || s.time_since_epoch() < -limit)
+            return nullptr;
+        }
+        return new T(std::chrono::floor<D>(s) + std::chrono::floor<D>(fraction));
+      }
+      else
+        throw std::logic_error("Unsupport convetor");
+    }
+
+    // true/false, 1/0, yes/no
+    template<>
+    inline void* base_convertor<bool>(const std::string_view& src)
+    {
+      auto e = details::bool_names.find(src);
+      return e ? new bool(e->value) : nullptr;
+    }
+
+    template<>
+    inline void* base_convertor<char>(const std::string_view& src)
+    {
+      return src.empty() ? nullptr : new char(src[0]);
+    }
+
+    template<>
+    inline void* base_convertor<unsigned char>(const std::string_view& src)
+    {
+      return src.empty() ? nullptr : new unsigned char(src[0]);
+    }
+
+#define REST_MAKE_BASE_CONVERTOR(Type)                                                                                 \
+  template<>                                                                                                           \
+  inline void* base_convertor<Type>(const std::string_view& src)                                                       \
+  {                                                                                                                    \
+    if (src.empty())                                                                                                   \
+      return nullptr;                                                                                                  \
+    auto ret = std::make_unique<Type>();                                                                               \
+    auto ec  = std::from_chars(src.data(), src.data() + src.size(), *ret).ec;                                          \
+    return (ec == std::errc()) ? (void*)ret.release() : nullptr;                                                       \
+  }
+
+    REST_MAKE_BASE_CONVERTOR(short);
+    REST_MAKE_BASE_CONVERTOR(int);
+    REST_MAKE_BASE_CONVERTOR(long);
+    REST_MAKE_BASE_CONVERTOR(long long);
+    REST_MAKE_BASE_CONVERTOR(unsigned short);
+    REST_MAKE_BASE_CONVERTOR(unsigned int);
+    REST_MAKE_BASE_CONVERTOR(unsigned long);
+    REST_MAKE_BASE_CONVERTOR(unsigned long long);
+    REST_MAKE_BASE_CONVERTOR(float);
+    REST_MAKE_BASE_CONVERTOR(double);
+    REST_MAKE_BASE_CONVERTOR(long double);
+
+#undef REST_MAKE_BASE_CONVERTOR
+
+    template<>
+    inline void* base_convertor<std::string>(const std::string_view& src)
+    {
+      return src.empty() ? nullptr : new std::string(src);
+    }
+
+    // sp: string_view
+    template<>
+    inline void* base_convertor<std::string_view>(const std::string_view& src)
+    {
+      return src.empty() ? nullptr : new std::string_view(src);
+    }
+
+    // YYYY-MM-DD
+    template<>
+    inline void* base_convertor<std::chrono::year_month_day>(const std::string_view& src)
+    {
+      std::chrono::year_month_day ymd;
+      return details::parse_date(src, ymd) ? new std::chrono::year_month_day(ymd) : nullptr;
+    }
+
+    // ]] ******************** Base Convertor ********************
+
+    /**
+     * @brief Apply the Range, MaxLength and OneOf tags to a converted value, a violation is cleaned and rejected
+     */
+    template<typename T, typename... Args>
+    inline bool constrain(void*& out, std::string_view name)
+    {
+      if constexpr (details::has_constraints<T, Args...>)
+      {
+        if (out && !details::satisfies<T, Args...>(*(T*)out))
+        {
+          std::cout << "Invalid param: " << name << std::endl;
+          clean<T>(out);
+          out = nullptr;
+          return false;
+        }
+      }
+      return true;
+    }
+
+    template<typename T>
+    struct convertor
+    {
+      bool operator()(void*&, Ctx&, int) { throw std::logic_error("Unsupport convetor"); }
+    };
+
+    template<typename T, typename... Args>
+    struct convertor<PathParam<T, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        if constexpr (PathParam<T, Args...>::isRequire)
+        {
+          if (!ctx.HasRestArg())
+            return false;
+          out = base_convertor<T>(ctx.GetRestArg());
+
+          if (out == nullptr)
+            std::cout << "Require path param: " << idx << std::endl;
+
+          return out != nullptr && constrain<T, Args...>(out, "path");
+        }
+        else // optional
+        {
+          if (!ctx.HasRestArg())
+            return true;
+          void* ptr = base_convertor<T>(ctx.GetRestArg());
+          out       = ptr ? ptr : (void*)PathParam<T, Args...>::MakeDefaultValue();
+          return constrain<T, Args...>(out, "path");
+        }
+      }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct convertor<UrlParam<T, Key, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        constexpr std::string_view key = Key.view();
+        if constexpr (UrlParam<T, Key, Args...>::isRequire)
+        {
+          out = base_convertor<T>(ctx.GetUrlParam(key));
+
+          if (out == nullptr)
+            std::cout << "Require url param: " << key << std::endl;
+
+          return out != nullptr && constrain<T, Args...>(out, key);
+        }
+        else // optional
+        {
+          void* ptr = base_convertor<T>(ctx.GetUrlParam(key));
+          out       = ptr ? ptr : (void*)UrlParam<T, Key, Args...>::MakeDefaultValue();
+          return constrain<T, Args...>(out, key);
+        }
+      }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct convertor<PostParam<T, Key, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        constexpr std::string_view key = Key.view();
+        if constexpr (PostParam<T, Key, Args...>::isRequire)
+        {
+          out = base_convertor<T>(ctx.GetContentParam(key));
+
+          if (out == nullptr)
+            std::cout << "Require post param: " << key << std::endl;
+
+          return out != nullptr && constrain<T, Args...>(out, key);
+        }
+        else // optional
+        {
+          void* ptr = base_convertor<T>(ctx.GetContentParam(key));
+          out       = ptr ? ptr : (void*)PostParam<T, Key, Args...>::MakeDefaultValue();
+          return constrain<T, Args...>(out, key);
+        }
+      }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct convertor<HeaderParam<T, Key, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        // Lowercased once at compile time, only the received names are folded per lookup
+        static constexpr auto key = details::to_lower(Key);
+        if constexpr (HeaderParam<T, Key, Args...>::isRequire)
+        {
+          out = base_convertor<T>(ctx.GetHeaderLowercase(key.view()));
+
+          if (out == nullptr)
+            std::cout << "Require header: " << Key.view() << std::endl;
+
+          return out != nullptr && constrain<T, Args...>(out, Key.view());
+        }
+        else // optional
+        {
+          void* ptr = base_convertor<T>(ctx.GetHeaderLowercase(key.view()));
+          out       = ptr ? ptr : (void*)HeaderParam<T, Key, Args...>::MakeDefaultValue();
+          return constrain<T, Args...>(out, Key.view());
+        }
+      }
+    };
+
+    /**
+     * @brief Convert src into an existing object, without the allocation of base_convertor for common types
+     */
+    template<typename T>
+    inline bool assign_value(T& out, std::string_view src)
+    {
+      constexpr bool integer = std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char> &&
+                               !std::is_same_v<T, unsigned char>;
+      if (src.empty())
+        return false;
+
+      if constexpr (integer)
+        return details::parse_integer(src, out);
+      else if constexpr (std::is_same_v<T, std::string> || std::is_same_v<T, std::string_view>)
+      {
+        out = T(src);
+        return true;
+      }
+      else
+      {
+        std::unique_ptr<T> value(static_cast<T*>(base_convertor<T>(src)));
+        if (!value)
+          return false;
+        out = std::move(*value);
+        return true;
+      }
+    }
+
+    /**
+     * @brief Append the comma separated values of src, empty ones are skipped
+     * @return false on an invalid value or once more than maxCount values are collected
+     */
+    template<typename T>
+    inline bool append_values(std::vector<T>& out, std::string_view src, size_t maxCount)
+    {
+      const char* p   = src.data();
+      const char* end = p + src.size();
+      for (;;)
+      {
+        const char*      comma = details::find_either(p, end, ',', ',');
+        std::string_view token(p, comma - p);
+        if (!token.empty() && (out.size() == maxCount || !assign_value(out.emplace_back(), token)))
+          return false;
+        if (comma == end)
+          return true;
+        p = comma + 1;
+      }
+    }
+
+    /**
+     * @brief Bind "k=v&..." to every declared field of T in one pass
+     * @brief The first occurrence of a scalar field wins, list fields collect them all, an invalid value counts as missing
+     * @return nullptr if a Require field is missing, or with rejected set if a field breaks its Range, MaxLength or OneOf tag
+     */
+    template<typename T>
+    inline void* base_fields_convertor(std::string_view params, bool& rejected)
+    {
+      using fields     = typename T::fields;
+      constexpr auto N = std::tuple_size_v<fields>;
+      static_assert(N <= 64, "an aggregate param supports up to 64 fields");
+
+      auto          obj     = std::make_unique<T>();
+      std::uint64_t found   = 0;
+      std::uint64_t invalid = 0;
+
+      auto bind = [&obj, &found, &invalid]<size_t I>(std::string_view key, std::string_view value)
+      {
+        using field = std::tuple_element_t<I, fields>;
+        if (key != field::key.view())
+          return false;
+
+        constexpr std::uint64_t bit = std::uint64_t(1) << I;
+        auto&                   dst = (*obj).*field::member;
+        if constexpr (details::is_vector<typename field::type>::value)
+        {
+          found |= bit;
+          if (!append_values(dst, value, field::maxCount))
+            invalid |= bit;
+        }
+        else if (!(found & bit) && assign_value(dst, value))
+          found |= bit;
+        return true;
+      };
+
+      while (!params.empty())
+      {
+        size_t           amp  = params.find('&');
+        std::string_view pair = params.substr(0, amp);
+        params                = amp == std::string_view::npos ? std::string_view() : params.substr(amp + 1);
+
+        size_t eq = pair.find('=');
+        if (eq == 0 || eq == std::string_view::npos)
+          continue;
+        [&]<size_t... I>(std::index_sequence<I...>)
+        { (bind.template operator()<I>(pair.substr(0, eq), pair.substr(eq + 1)) || ...); }(std::make_index_sequence<N>());
+      }
+
+      bool ok = [&]<size_t... I>(std::index_sequence<I...>)
+      {
+        auto check = [&]<size_t J>()
+        {
+          using field = std::tuple_element_t<J, fields>;
+          if ((found & ~invalid) & (std::uint64_t(1) << J))
+          {
+            if (field::Satisfies(*obj))
+              return true;
+            std::cout << "Invalid field: " << field::key.view() << std::endl;
+            rejected = true;
+            return false;
+          }
+          if constexpr (details::is_vector<typename field::type>::value)
+            ((*obj).*field::member).clear();
+          if constexpr (field::isRequire)
+          {
+            std::cout << "Require field: " << field::key.view() << std::endl;
+            return false;
+          }
+          field::SetDefaultValue(*obj);
+          return true;
+        };
+        return (check.template operator()<I>() && ...);
+      }(std::make_index_sequence<N>());
+
+      return ok ? obj.release() : nullptr;
+    }
+
+    template<typename T, typename... Args>
+    struct convertor<UrlParams<T, Args...>>
+    {
+      static_assert(details::has_fields<T>, "UrlParams needs T::fields, see Field");
+
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        bool rejected = false;
+        if constexpr (UrlParams<T, Args...>::isRequire)
+        {
+          out = base_fields_convertor<T>(ctx.GetRawUrlParams(), rejected);
+
+          if (out == nullptr && !rejected)
+            std::cout << "Require url params" << std::endl;
+
+          return out != nullptr;
+        }
+        else // optional
+        {
+          void* ptr = base_fields_convertor<T>(ctx.GetRawUrlParams(), rejected);
+          out       = ptr ? ptr : (void*)UrlParams<T, Args...>::MakeDefaultValue();
+          return !rejected;
+        }
+      }
+    };
+
+    template<typename T, typename... Args>
+    struct convertor<PostParams<T, Args...>>
+    {
+      static_assert(details::has_fields<T>, "PostParams needs T::fields, see Field");
+
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        bool rejected = false;
+        if constexpr (PostParams<T, Args...>::isRequire)
+        {
+          out = base_fields_convertor<T>(ctx.GetRawContentBody(), rejected);
+
+          if (out == nullptr && !rejected)
+            std::cout << "Require post params" << std::endl;
+
+          return out != nullptr;
+        }
+        else // optional
+        {
+          void* ptr = base_fields_convertor<T>(ctx.GetRawContentBody(), rejected);
+          out       = ptr ? ptr : (void*)PostParams<T, Args...>::MakeDefaultValue();
+          return !rejected;
+        }
+      }
+    };
+
+    /**
+     * @brief Collect every occurrence of a key, each may be a comma separated list: ids=1,2&ids=3 -> [1, 2, 3]
+     * @brief The Range, MaxLength and OneOf tags apply to every element
+     * @return nullptr if the key is absent, or with rejected set if it has an invalid value, an element breaking a tag
+     * @return or more than MaxCount values
+     */
+    template<typename T, typename... Args, typename ForEach>
+    inline void* base_list_convertor(ForEach&& forEach, bool& rejected)
+    {
+      auto values = std::make_unique<std::vector<T>>();
+      bool seen   = false;
+      bool ok     = forEach(
+          [&values, &seen](std::string_view value)
+          {
+            seen = true;
+            return append_values(*values, value, details::max_count<Args...>());
+          });
+      if constexpr (details::has_constraints<T, Args...>)
+        ok = ok && std::all_of(values->begin(), values->end(),
+                               [](const T& value) { return details::satisfies<T, Args...>(value); });
+      rejected = seen && !ok;
+      return ok && !values->empty() ? values.release() : nullptr;
+    }
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct convertor<UrlParam<std::vector<T>, Key, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        constexpr std::string_view key   = Key.view();
+        auto                       query = [&ctx](auto&& cb) { return ctx.ForEachUrlParam(Key.view(), cb); };
+        bool rejected = false;
+        if constexpr (UrlParam<std::vector<T>, Key, Args...>::isRequire)
+        {
+          out = base_list_convertor<T, Args...>(query, rejected);
+
+          if (rejected)
+            std::cout << "Invalid param: " << key << std::endl;
+          else if (out == nullptr)
+            std::cout << "Require url param: " << key << std::endl;
+
+          return out != nullptr;
+        }
+        else // optional
+        {
+          // Only an absent key falls back to the default, a present but invalid one is rejected
+          void* ptr = base_list_convertor<T, Args...>(query, rejected);
+          out       = ptr ? ptr : (void*)UrlParam<std::vector<T>, Key, Args...>::MakeDefaultValue();
+
+          if (rejected)
+            std::cout << "Invalid param: " << key << std::endl;
+
+          return !rejected;
+        }
+      }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct convertor<PostParam<std::vector<T>, Key, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        constexpr std::string_view key  = Key.view();
+        auto                       form = [&ctx](auto&& cb) { return ctx.ForEachContentParam(Key.view(), cb); };
+        bool rejected = false;
+        if constexpr (PostParam<std::vector<T>, Key, Args...>::isRequire)
+        {
+          out = base_list_convertor<T, Args...>(form, rejected);
+
+          if (rejected)
+            std::cout << "Invalid param: " << key << std::endl;
+          else if (out == nullptr)
+            std::cout << "Require post param: " << key << std::endl;
+
+          return out != nullptr;
+        }
+        else // optional
+        {
+          // Only an absent key falls back to the default, a present but invalid one is rejected
+          void* ptr = base_list_convertor<T, Args...>(form, rejected);
+          out       = ptr ? ptr : (void*)PostParam<std::vector<T>, Key, Args...>::MakeDefaultValue();
+
+          if (rejected)
+            std::cout << "Invalid param: " << key << std::endl;
+
+          return !rejected;
+        }
+      }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct convertor<CookieParam<T, Key, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        constexpr std::string_view key = Key.view();
+        if constexpr (CookieParam<T, Key, Args...>::isRequire)
+        {
+          out = base_convertor<T>(ctx.GetCookie(key));
+
+          if (out == nullptr)
+            std::cout << "Require cookie: " << key << std::endl;
+
+          return out != nullptr && constrain<T, Args...>(out, key);
+        }
+        else // optional
+        {
+          void* ptr = base_convertor<T>(ctx.GetCookie(key));
+          out       = ptr ? ptr : (void*)CookieParam<T, Key, Args...>::MakeDefaultValue();
+          return constrain<T, Args...>(out, key);
+        }
+      }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct convertor<PathVar<T, Key, Args...>>
+    {
+      static_assert(!std::is_same_v<T, T>, "PathVar needs a route pattern, use RegisterRestful<\"/path/{var}\">(callback)");
+    };
+
+    /**
+     * @brief PathVar reads the Index-th variable captured by the router, Index is resolved from the pattern
+     */
+    template<size_t Index, typename Param>
+    struct path_var_convertor
+    {
+    };
+
+    template<size_t Index, typename T, details::string_literal Key, typename... Args>
+    struct path_var_convertor<Index, PathVar<T, Key, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        if constexpr (PathVar<T, Key, Args...>::isRequire)
+        {
+          out = base_convertor<T>(ctx.GetPathVar(Index));
+
+          if (out == nullptr)
+            std::cout << "Require path var: " << Key.view() << std::endl;
+
+          return out != nullptr && constrain<T, Args...>(out, Key.view());
+        }
+        else // optional
+        {
+          void* ptr = base_convertor<T>(ctx.GetPathVar(Index));
+          out       = ptr ? ptr : (void*)PathVar<T, Key, Args...>::MakeDefaultValue();
+          return constrain<T, Args...>(out, Key.view());
+        }
+      }
+    };
+
+    /**
+     * @brief Convertor of a handler arg registered with route pattern Pattern
+     */
+    template<details::string_literal Pattern, typename Param>
+    struct pattern_convertor
+    {
+      using type = convertor<Param>;
+    };
+
+    template<details::string_literal Pattern, typename T, details::string_literal Key, typename... Args>
+    struct pattern_convertor<Pattern, PathVar<T, Key, Args...>>
+    {
+      static constexpr size_t index = details::route_pattern<Pattern>::index_of(Key.view());
+      static_assert(index != std::string_view::npos, "PathVar key is not a variable of the route pattern");
+
+      using type = path_var_convertor<index, PathVar<T, Key, Args...>>;
+    };
+
+    template<typename T, typename... Args>
+    struct convertor<PostBody<T, Args...>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        if constexpr (details::has_body_codec<T>)
+          return body(out, ctx);
+        else if constexpr (PostBody<T, Args...>::isRequire)
+        {
+          out = base_convertor<T>(ctx.GetRawContentBody());
+
+          if (out == nullptr)
+            std::cout << "Require post body" << std::endl;
+
+          return out != nullptr && constrain<T, Args...>(out, "body");
+        }
+        else // optional
+        {
+          void* ptr = base_convertor<T>(ctx.GetRawContentBody());
+          out       = ptr ? ptr : (void*)PostBody<T, Args...>::MakeDefaultValue();
+          return constrain<T, Args...>(out, "body");
+        }
+      }
+
+      // Aggregates decoded from JSON, MessagePack or CBOR, picked by Content-Type
+      bool body(void*& out, Ctx& ctx)
+      {
+        std::string_view src = ctx.GetRawContentBody();
+        if (!src.empty())
+        {
+          auto obj      = std::make_unique<T>();
+          bool rejected = false;
+          if (Decode(ContentFormat(ctx), src, *obj, &rejected))
+          {
+            out = obj.release();
+            return constrain<T, Args...>(out, "body");
+          }
+          if (rejected)
+            return false;
+        }
+
+        if constexpr (PostBody<T, Args...>::isRequire)
+        {
+          std::cout << "Require post body" << std::endl;
+          return false;
+        }
+        else
+        {
+          out = (void*)PostBody<T, Args...>::MakeDefaultValue();
+          return true;
+        }
+      }
+    };
+
+    template<typename Result>
+    void clean(void* ptr)
+    {
+      // Values collected by list and aggregate params, named enums, durations and time points
+      if constexpr (details::is_vector<Result>::value || details::has_fields<Result> || details::has_enum_names<Result> ||
+                    details::is_duration<Result>::value || details::is_sys_time<Result>::value)
+        delete (Result*)ptr;
+    }
+
+#define REST_MAKE_DEFAULT_CLEANER(type)                                                                                \
+  template<>                                                                                                           \
+  inline void clean<type>(void* ptr)                                                                                   \
+  {                                                                                                                    \
+    if (ptr)                                                                                                           \
+      delete (type*)ptr;                                                                                               \
+  }
+
+    REST_MAKE_DEFAULT_CLEANER(bool);
+    REST_MAKE_DEFAULT_CLEANER(char);
+    REST_MAKE_DEFAULT_CLEANER(short);
+    REST_MAKE_DEFAULT_CLEANER(int);
+    REST_MAKE_DEFAULT_CLEANER(long);
+    REST_MAKE_DEFAULT_CLEANER(long long);
+    REST_MAKE_DEFAULT_CLEANER(unsigned char);
+    REST_MAKE_DEFAULT_CLEANER(unsigned short);
+    REST_MAKE_DEFAULT_CLEANER(unsigned int);
+    REST_MAKE_DEFAULT_CLEANER(unsigned long);
+    REST_MAKE_DEFAULT_CLEANER(unsigned long long);
+    REST_MAKE_DEFAULT_CLEANER(float);
+    REST_MAKE_DEFAULT_CLEANER(double);
+    REST_MAKE_DEFAULT_CLEANER(long double);
+    REST_MAKE_DEFAULT_CLEANER(std::string);
+    REST_MAKE_DEFAULT_CLEANER(std::string_view);
+    REST_MAKE_DEFAULT_CLEANER(std::chrono::year_month_day);
+
+#undef REST_MAKE_DEFAULT_CLEANER
+
+    template<typename Convertor>
+    bool convert(void*& out, Ctx& ctx, int idx)
+    {
+      return Convertor()(out, ctx, idx);
+    }
+
+    /**
+     * @brief One table per distinct parameter list, shared by every route with that list
+     */
+    template<typename... Convertors>
+    inline constexpr std::array<Convertor_t, sizeof...(Convertors)> convertor_table{&convert<Convertors>...};
+
+    template<typename... Types>
+    inline constexpr std::array<Cleaner_t, sizeof...(Types)> cleaner_table{&clean<Types>...};
+  } // namespace ArgConvertors
+
+  namespace details
+  {
+    /**
+     * @brief Thrown by the first access to a Lazy param that fails to convert, the invoker answers it with 400
+     */
+    struct lazy_rejected: std::runtime_error
+    {
+      lazy_rejected(): std::runtime_error("lazy param is invalid") {}
+    };
+  } // namespace details
+
+  /**
+   * @brief Lazy modifier, the wrapped param is converted on first access and cached, e.g. Lazy<PostBody<std::string>>
+   * @brief A Require param is checked for presence before the handler runs, input that then fails to convert (or
+   * @brief breaks a constraint) ends the handler at that first access and the request gets 400, like an eager param
+   */
+  template<typename Param>
+  struct Lazy
+  {
+    // Owned and cleaned by the wrapper itself
+    using type       = Lazy<Param>;
+    using value_type = typename Param::type;
+    using pointer    = value_type*;
+    using reference  = value_type&;
+
+    static constexpr bool isRequire = Param::isRequire;
+
+    Lazy(void* pctx): ctx((Ctx*)pctx) {}
+
+    Lazy(Lazy&& o) noexcept: ctx(o.ctx), obj(o.obj), converted(o.converted) { o.obj = nullptr; }
+
+    Lazy(const Lazy&)            = delete;
+    Lazy& operator=(const Lazy&) = delete;
+
+    ~Lazy() { ArgConvertors::clean<value_type>(obj); }
+
+    operator bool() { return get() != nullptr; }
+
+    reference operator*() { return *checked(); }
+
+    pointer operator->() { return checked(); }
+
+    pointer get()
+    {
+      if (!converted)
+      {
+        converted = true;
+        void* out = nullptr;
+        if (!ArgConvertors::convertor<Param>()(out, *ctx, 0))
+        {
+          ArgConvertors::clean<value_type>(out);
+          throw details::lazy_rejected();
+        }
+        obj = (pointer)out;
+      }
+      return obj;
+    }
+
+    friend std::ostream& operator<<(std::ostream& os, Lazy<Param>& o)
+    {
+      if (o.get())
+        os << *o;
+      return os;
+    }
+
+  private:
+    // An optional param without a default value has nothing to dereference
+    pointer checked()
+    {
+      if (!get())
+        throw std::logic_error("lazy param has no value, test it before dereferencing");
+      return obj;
+    }
+
+    Ctx*    ctx;
+    pointer obj       = nullptr;
+    bool    converted = false;
+  };
+
+  namespace ArgConvertors
+  {
+    /**
+     * @brief Raw text a param is converted from, used for the presence check of a Lazy Require param
+     */
+    template<typename Param>
+    struct raw_source
+    {
+      static_assert(!std::is_same_v<Param, Param>, "Lazy supports UrlParam, PostParam, PostBody, HeaderParam, "
+                                                   "CookieParam, UrlParams and PostParams");
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct raw_source<UrlParam<T, Key, Args...>>
+    {
+      static std::string_view get(Ctx& ctx) { return ctx.GetUrlParam(Key.view()); }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct raw_source<PostParam<T, Key, Args...>>
+    {
+      static std::string_view get(Ctx& ctx) { return ctx.GetContentParam(Key.view()); }
+    };
+
+    template<typename T, typename... Args>
+    struct raw_source<PostBody<T, Args...>>
+    {
+      static std::string_view get(Ctx& ctx) { return ctx.GetRawContentBody(); }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct raw_source<HeaderParam<T, Key, Args...>>
+    {
+      static std::string_view get(Ctx& ctx) { return ctx.GetHeader(Key.view()); }
+    };
+
+    template<typename T, details::string_literal Key, typename... Args>
+    struct raw_source<CookieParam<T, Key, Args...>>
+    {
+      static std::string_view get(Ctx& ctx) { return ctx.GetCookie(Key.view()); }
+    };
+
+    template<typename T, typename... Args>
+    struct raw_source<UrlParams<T, Args...>>
+    {
+      static std::string_view get(Ctx& ctx) { return ctx.GetRawUrlParams(); }
+    };
+
+    template<typename T, typename... Args>
+    struct raw_source<PostParams<T, Args...>>
+    {
+      static std::string_view get(Ctx& ctx) { return ctx.GetRawContentBody(); }
+    };
+
+    template<typename Param>
+    struct convertor<Lazy<Param>>
+    {
+      bool operator()(void*& out, Ctx& ctx, int idx)
+      {
+        if constexpr (Param::isRequire)
+        {
+          if (raw_source<Param>::get(ctx).empty())
+          {
+            std::cout << "Require lazy param: " << idx << std::endl;
+            return false;
+          }
+        }
+        // Lazy only keeps the Ctx, nothing to clean
+        out = &ctx;
+        return true;
+      }
+    };
+
+    /**
+     * @brief Params known once the request line and headers are parsed, checked by Apis::Admit before the body is read
+     */
+    template<typename Param>
+    inline constexpr bool header_time = false;
+
+    template<typename T, typename... Args>
+    inline constexpr bool header_time<PathParam<T, Args...>> = true;
+
+    template<typename T, details::string_literal Key, typename... Args>
+    inline constexpr bool header_time<PathVar<T, Key, Args...>> = true;
+
+    template<typename T, details::string_literal Key, typename... Args>
+    inline constexpr bool header_time<UrlParam<T, Key, Args...>> = true;
+
+    template<typename T, details::string_literal Key, typename... Args>
+    inline constexpr bool header_time<HeaderParam<T, Key, Args...>> = true;
+
+    template<typename T, details::string_literal Key, typename... Args>
+    inline constexpr bool header_time<CookieParam<T, Key, Args...>> = true;
+
+    template<typename T, typename... Args>
+    inline constexpr bool header_time<UrlParams<T, Args...>> = true;
+
+    /**
+     * @brief Arg indices of the header-time params, one table per distinct parameter list like the convertor tables
+     */
+    template<typename... Params>
+    struct header_time_table
+    {
+      static constexpr size_t count = (size_t(header_time<Params>) + ... + 0);
+
+      static constexpr std::array<int, count> indices = []
+      {
+        constexpr bool         early[] = {header_time<Params>..., false};
+        std::array<int, count> out{};
+        for (size_t i = 0, n = 0; i < sizeof...(Params); ++i)
+          if (early[i])
+            out[n++] = int(i);
+        return out;
+      }();
+    };
+  } // namespace ArgConvertors
+
+  /**
+   * @brief Cheap resource version, checked before the handler runs
+   * @brief tag is turned into the strong ETag, lastModified into Last-Modified (0 means unknown)
+   */
+  struct ResourceVersion
+  {
+    std::uint64_t tag          = 0;
+    std::time_t   lastModified = 0;
+  };
+
+  /**
+   * @brief Accept-Encoding negotiated response compression, only active when built with REST_USE_ZLIB
+   */
+  struct CompressionOptions
+  {
+    // Bodies smaller than this are sent as is, 0 disables compression for the route
+    // The effective threshold adapts: it grows while responses compress poorly and shrinks back when they do well
+    size_t minSize = 1024;
+    // zlib level, 1 keeps latency low at a small cost in ratio
+    int level = 1;
+  };
+
+  enum class Execution : std::uint8_t
+  {
+    // On the calling (I/O) thread, for cheap handlers
+    Inline,
+    // On the WorkerPool, the response is posted back through a CompletionQueue
+    Offload,
+  };
+
+  enum class Priority : std::uint8_t
+  {
+    // Health checks, latency critical lookups
+    Interactive,
+    Normal,
+    // Exports and other throughput oriented work, takes the remaining capacity
+    Bulk,
+  };
+
+  enum class RateLimitKey : std::uint8_t
+  {
+    // One bucket for the whole route
+    Route,
+    // One bucket per Ctx::GetRemoteAddress()
+    ClientIp,
+    // One bucket per value of the header named keyName
+    Header,
+    // One bucket per value of the url param named keyName
+    UrlParam,
+  };
+
+  struct RateLimitOptions
+  {
+    // Requests per second, 0 disables rate limiting
+    double rate = 0;
+    // Requests allowed back to back, 0 means max(1, rate)
+    double burst = 0;
+
+    RateLimitKey key = RateLimitKey::Route;
+    std::string  keyName;
+    // Bound of tracked keys, idle ones are evicted first
+    size_t maxKeys = 1 << 16;
+  };
+
+  /**
+   * @brief Per route options, given at RegisterRestful time
+   *
+   * @example
+    apis.RegisterRestful("/user", callback, {.version = [](Ctx& ctx) -> ResourceVersion { return {userTableVersion}; }});
+   */
+  struct RouteOptions
+  {
+    // If set, conditional requests are answered with 304 without invoking the handler
+    std::function<ResourceVersion(Ctx&)> version;
+
+    CompressionOptions compression;
+
+    // The handler may run concurrently with other requests, e.g. the sub-requests of a batch
+    bool parallelSafe = false;
+
+    // Where Apis::Submit runs the handler
+    Execution execution = Execution::Inline;
+    // Run queue class of offloaded work, see WorkerPool
+    Priority priority = Priority::Normal;
+
+    // Over-limit requests get 429 from Apis::Admit, before any parameter conversion
+    RateLimitOptions rateLimit;
+
+    // Handler deadline counted from admission, 0 means none, see Ctx::Expired
+    // A request still queued when it passes is answered with 504 without running the handler
+    std::chrono::milliseconds deadline{0};
+  };
+
+  struct BatchOptions
+  {
+    // Larger batches are rejected with 413
+    size_t maxRequests = 64;
+    // Upper bound of sub-requests running at the same time, 0 means hardware concurrency
+    size_t maxParallel = 0;
+  };
+
+  /**
+   * @brief Cross-origin resource sharing, preflights are answered by the router without invoking handlers
+   */
+  struct CorsOptions
+  {
+    // "*" allows any origin
+    std::vector<std::string> allowOrigins = {"*"};
+    // Empty echoes the preflight's Access-Control-Request-Headers
+    std::vector<std::string> allowHeaders;
+    std::vector<std::string> exposeHeaders;
+
+    bool allowCredentials = false;
+
+    // How long browsers may cache a preflight
+    std::chrono::seconds maxAge{600};
+  };
+
+  namespace details
+  {
+    /**
+     * @brief Streaming 64-bit non-cryptographic hash, independent of how the input is segmented
+     */
+    class hasher
+    {
+    public:
+      void update(std::string_view data)
+      {
+        total += data.size();
+        if (tailLen)
+        {
+          while (tailLen < 8 && !data.empty())
+          {
+            tail[tailLen++] = data.front();
+            data.remove_prefix(1);
+          }
+          if (tailLen < 8)
+            return;
+          mix(load(tail));
+          tailLen = 0;
+        }
+        while (data.size() >= 8)
+        {
+          mix(load(data.data()));
+          data.remove_prefix(8);
+        }
+        std::copy(data.begin(), data.end(), tail);
+        tailLen = data.size();
+      }
+
+      std::uint64_t digest() const
+      {
+        std::uint64_t h = state ^ (total * k1);
+        if (tailLen)
+        {
+          char last[8] = {};
+          std::copy_n(tail, tailLen, last);
+          h = round(h, load(last));
+        }
+        // murmur3 fmix64
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdull;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ull;
+        h ^= h >> 33;
+        return h;
+      }
+
+    private:
+      static constexpr std::uint64_t k1 = 0x9e3779b97f4a7c15ull;
+      static constexpr std::uint64_t k2 = 0xc2b2ae3d27d4eb4full;
+
+      static std::uint64_t load(const char* p)
+      {
+        std::uint64_t v;
+        std::memcpy(&v, p, sizeof(v));
+        return v;
+      }
+
+      static std::uint64_t round(std::uint64_t h, std::uint64_t v)
+      {
+        h ^= v * k2;
+        h = (h << 31) | (h >> 33);
+        return h * k1;
+      }
+
+      void mix(std::uint64_t v) { state = round(state, v); }
+
+      std::uint64_t state   = k2;
+      std::uint64_t total   = 0;
+      char          tail[8] = {};
+      size_t        tailLen = 0;
+    };
+
+    inline std::string format_etag(std::uint64_t tag)
+    {
+      static constexpr char digits[] = "0123456789abcdef";
+
+      std::string ret(16, '0');
+      for (int i = 15; i >= 0; --i, tag >>= 4)
+        ret[i] = digits[tag & 0xf];
+      return ret;
+    }
+
+    // Howard Hinnant's days_from_civil / civil_from_days, avoids gmtime/timegm portability issues
+    constexpr std::int64_t days_from_civil(std::int64_t y, unsigned m, unsigned d)
+    {
+      y -= m <= 2;
+      const std::int64_t era = (y >= 0 ? y : y - 399) / 400;
+      const unsigned     yoe = static_cast<unsigned>(y - era * 400);
+      const unsigned     doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+      const unsigned     doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+      return era * 146097 + static_cast<std::int64_t>(doe) - 719468;
+    }
+
+    constexpr void civil_from_days(std::int64_t z, std::int64_t& y, unsigned& m, unsigned& d)
+    {
+      z += 719468;
+      const std::int64_t era = (z >= 0 ? z : z - 146096) / 146097;
+      const unsigned     doe = static_cast<unsigned>(z - era * 146097);
+      const unsigned     yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+      const unsigned     doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+      const unsigned     mp  = (5 * doy + 2) / 153;
+      d                      = doy - (153 * mp + 2) / 5 + 1;
+      m                      = mp < 10 ? mp + 3 : mp - 9;
+      y                      = static_cast<std::int64_t>(yoe) + era * 400 + (m <= 2);
+    }
+
+    inline constexpr const char* week_names[]  = {"Thu", "Fri", "Sat", "Sun", "Mon", "Tue", "Wed"};
+    inline constexpr const char* month_names[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                                  "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+    /**
+     * @brief Format as IMF-fixdate, e.g. "Sun, 06 Nov 1994 08:49:37 GMT"
+     */
+    inline std::string format_http_date(std::time_t t)
+    {
+      std::int64_t days = t / 86400, secs = t % 86400;
+      if (secs < 0)
+      {
+        secs += 86400;
+        --days;
+      }
+      std::int64_t y;
+      unsigned     m, d;
+      civil_from_days(days, y, m, d);
+
+      char buf[32];
+      std::snprintf(buf, sizeof(buf), "%s, %02u %s %04d %02d:%02d:%02d GMT", week_names[((days % 7) + 7) % 7], d,
+                    month_names[m - 1], (int)y, (int)(secs / 3600), (int)(secs / 60 % 60), (int)(secs % 60));
+      return buf;
+    }
+
+    /**
+     * @brief Parse IMF-fixdate, the obsolete RFC 850 and asctime forms are not accepted
+     * @return -1 on failure
+     */
+    inline std::time_t parse_http_date(std::string_view src)
+    {
+      if (src.size() != 29 || src[3] != ',' || src.substr(25) != " GMT")
+        return -1;
+
+      auto num = [&](size_t off, size_t len) -> int
+      {
+        int val = 0;
+        for (size_t i = off; i < off + len; ++i)
+        {
+          if (src[i] < '0' || src[i] > '9')
+            return -1;
+          val = val * 10 + (src[i] - '0');
+        }
+        return val;
+      };
+
+      int      day = num(5, 2), year = num(12, 4), hh = num(17, 2), mm = num(20, 2), ss = num(23, 2);
+      unsigned month = 0;
+      for (unsigned i = 0; i < 12; ++i)
+        if (src.substr(8, 3) == month_names[i])
+          month = i + 1;
+
+      if (day < 1 || year < 0 || hh < 0 || mm < 0 || ss < 0 || month == 0)
+        return -1;
+
+      return static_cast<std::time_t>(days_from_civil(year, month, day) * 86400 + hh * 3600 + mm * 60 + ss);
+    }
+
+    /**
+     * @brief Weak comparison of If-None-Match list against an unquoted strong etag
+     */
+    inline bool etag_match(std::string_view ifNoneMatch, std::string_view etag)
+    {
+      while (!ifNoneMatch.empty())
+      {
+        size_t           comma = ifNoneMatch.find(',');
+        std::string_view item  = ifNoneMatch.substr(0, comma);
+        ifNoneMatch = comma == std::string_view::npos ? std::string_view() : ifNoneMatch.substr(comma + 1);
+
+        while (!item.empty() && item.front() == ' ')
+          item.remove_prefix(1);
+        while (!item.empty() && item.back() == ' ')
+          item.remove_suffix(1);
+
+        if (item == "*")
+          return true;
+        if (item.starts_with("W/"))
+          item.remove_prefix(2);
+        if (item.size() < 2 || item.front() != '"' || item.back() != '"')
+          continue;
+
+        // Compressed variants are tagged "<etag>-gzip" / "<etag>-deflate" but validate the same resource
+        item = item.substr(1, item.size() - 2);
+        if (item.starts_with(etag))
+        {
+          item.remove_prefix(etag.size());
+          if (item.empty() || item == "-gzip" || item == "-deflate")
+            return true;
+        }
+      }
+      return false;
+    }
+
+    /**
+     * @brief RFC 9110 13.2.2: If-None-Match takes precedence, If-Modified-Since is only evaluated without it
+     */
+    inline bool not_modified(const Ctx& ctx, std::string_view etag, std::time_t lastModified)
+    {
+      std::string_view ifNoneMatch = ctx.GetHeader("If-None-Match");
+      if (!ifNoneMatch.empty())
+        return !etag.empty() && etag_match(ifNoneMatch, etag);
+
+      std::string_view ifModifiedSince = ctx.GetHeader("If-Modified-Since");
+      if (!ifModifiedSince.empty() && lastModified > 0)
+      {
+        std::time_t since = parse_http_date(ifModifiedSince);
+        return since >= 0 && lastModified <= since;
+      }
+      return false;
+    }
+
+    /**
+     * @brief Attach validators to a 200 response and turn it into 304 when the request preconditions hold
+     */
+    inline void apply_validators(const Ctx& ctx, Ret& ret)
+    {
+      // A rendered response carries its own validators
+      if (ret.status != 200 || ret.wire)
+        return;
+
+      if (ret.etag.empty())
+      {
+        hasher h;
+        ret.ForEachSegment([&h](std::string_view segment) { h.update(segment); });
+        ret.etag = format_etag(h.digest());
+      }
+      if (!ret.FindHeader("ETag"))
+        ret.headers.emplace_back("ETag", "\"" + ret.etag + "\"");
+      if (ret.lastModified > 0 && !ret.FindHeader("Last-Modified"))
+        ret.headers.emplace_back("Last-Modified", format_http_date(ret.lastModified));
+
+      if (not_modified(ctx, ret.etag, ret.lastModified))
+      {
+        ret.status = 304;
+        ret.ClearBody();
+        ret.filePath.clear();
+        ret.fileOffset = ret.fileLength = 0;
+      }
+    }
+
+    /**
+     * @brief shared_ptr published by one thread and loaded by many, std::atomic<std::shared_ptr> where available
+     */
+    template<typename T>
+    class atomic_shared
+    {
+    public:
+      std::shared_ptr<T> load() const
+      {
+#ifdef __cpp_lib_atomic_shared_ptr
+        return ptr.load(std::memory_order_acquire);
+#else
+        return std::atomic_load_explicit(&ptr, std::memory_order_acquire);
+#endif
+      }
+
+      void store(std::shared_ptr<T> value)
+      {
+#ifdef __cpp_lib_atomic_shared_ptr
+        ptr.store(std::move(value), std::memory_order_release);
+#else
+        std::atomic_store_explicit(&ptr, std::move(value), std::memory_order_release);
+#endif
+      }
+
+      // Replaces the pointer with desired only if it still equals expected, otherwise loads it into expected
+      bool compare_exchange(std::shared_ptr<T>& expected, std::shared_ptr<T> desired)
+      {
+#ifdef __cpp_lib_atomic_shared_ptr
+        return ptr.compare_exchange_strong(expected, std::move(desired), std::memory_order_acq_rel,
+                                           std::memory_order_acquire);
+#else
+        return std::atomic_compare_exchange_strong_explicit(&ptr, &expected, std::move(desired),
+                                                            std::memory_order_acq_rel, std::memory_order_acquire);
+#endif
+      }
+
+    private:
+#ifdef __cpp_lib_atomic_shared_ptr
+      std::atomic<std::shared_ptr<T>> ptr;
+#else
+      std::shared_ptr<T> ptr;
+#endif
+    };
+
+    inline std::string_view reason_phrase(int status)
+    {
+      switch (status)
+      {
+        case 100: return "Continue";
+        case 101: return "Switching Protocols";
+        case 200: return "OK";
+        case 201: return "Created";
+        case 202: return "Accepted";
+        case 204: return "No Content";
+        case 206: return "Partial Content";
+        case 301: return "Moved Permanently";
+        case 302: return "Found";
+        case 303: return "See Other";
+        case 304: return "Not Modified";
+        case 307: return "Temporary Redirect";
+        case 308: return "Permanent Redirect";
+        case 400: return "Bad Request";
+        case 401: return "Unauthorized";
+        case 403: return "Forbidden";
+        case 404: return "Not Found";
+        case 405: return "Method Not Allowed";
+        case 408: return "Request Timeout";
+        case 409: return "Conflict";
+        case 410: return "Gone";
+        case 412: return "Precondition Failed";
+        case 413: return "Content Too Large";
+        case 415: return "Unsupported Media Type";
+        case 416: return "Range Not Satisfiable";
+        case 422: return "Unprocessable Content";
+        case 429: return "Too Many Requests";
+        case 500: return "Internal Server Error";
+        case 501: return "Not Implemented";
+        case 502: return "Bad Gateway";
+        case 503: return "Service Unavailable";
+        case 504: return "Gateway Timeout";
+        default: return "";
+      }
+    }
+  } // namespace details
+
+  /**
+   * @brief Value of the Date header shared by every response, refreshed by the event loop instead of formatted per request
+   *
+   * @example
+    TimerWheel wheel;
+    std::function<void()> tick = [&] { HttpDate::Refresh(); wheel.Arm(std::chrono::seconds(1), tick); };
+    tick();
+   */
+  class HttpDate
+  {
+  public:
+    /**
+     * @brief Call from the event loop at least once per second, any thread may call it
+     * @return true if the value changed
+     */
+    static bool Refresh(std::time_t now = std::time(nullptr))
+    {
+      state& s       = get();
+      auto   current = s.latest.load();
+      if (current->second >= now)
+        return false;
+      // Formatted once, a refresher that lost to a newer second drops it instead of publishing older text
+      auto next = std::make_shared<const stamp>(now, details::format_http_date(now));
+      while (!s.latest.compare_exchange(current, next))
+        if (current->second >= now)
+          return false;
+      return true;
+    }
+
+    // Current value, "Sun, 06 Nov 1994 08:49:37 GMT", never null
+    static std::shared_ptr<const std::string> Get()
+    {
+      auto current = get().latest.load();
+      return {current, &current->value};
+    }
+
+  private:
+    struct stamp
+    {
+      std::time_t second;
+      std::string value;
+    };
+
+    struct state
+    {
+      // Formatted eagerly, the first Get() of racing threads already has a value to return
+      details::atomic_shared<const stamp> latest;
+
+      state()
+      {
+        std::time_t now = std::time(nullptr);
+        latest.store(std::make_shared<const stamp>(now, details::format_http_date(now)));
+      }
+    };
+
+    static state& get()
+    {
+      static state s;
+      return s;
+    }
+  };
+
+  /**
+   * @brief Serialize the status line and headers of ret for HTTP/1.1, ending with the blank line
+   * @brief Date comes from HttpDate, Content-Length is added from the body unless ret already has one
+   */
+  inline void WriteHead(const Ret& ret, std::string& out)
+  {
+    char status[4];
+    std::to_chars(status, status + 4, std::clamp(ret.status, 100, 999));
+    out += "HTTP/1.1 ";
+    out.append(status, 3);
+    out += ' ';
+    out += details::reason_phrase(ret.status);
+    out += "\r\n";
+
+    for (auto& [key, value]: ret.headers)
+    {
+      out += key;
+      out += ": ";
+      out += value;
+      out += "\r\n";
+    }
+
+    if (!ret.FindHeader("Date"))
+    {
+      out += "Date: ";
+      out += *HttpDate::Get();
+      out += "\r\n";
+    }
+
+    bool noBody = ret.status < 200 || ret.status == 204 || ret.status == 304;
+    if (!noBody && !ret.FindHeader("Content-Length"))
+    {
+      out += "Content-Length: ";
+      out += std::to_string(ret.filePath.empty() ? std::uint64_t(ret.BodySize()) : ret.fileLength);
+      out += "\r\n";
+    }
+    out += "\r\n";
+  }
+
+  namespace details
+  {
+    /**
+     * @brief Response of RegisterConstant, rendered into complete HTTP/1.1 responses once per Date change
+     */
+    class constant_response
+    {
+    public:
+      explicit constant_response(Ret _ret): ret(std::move(_ret))
+      {
+        ret.Flatten();
+        if (!ret.sharedBody)
+          ret.sharedBody = std::make_shared<const std::string>(std::move(ret.body));
+        ret.body.clear();
+
+        if (ret.status == 200)
+        {
+          if (ret.etag.empty())
+          {
+            hasher h;
+            h.update(ret.GetBody());
+            ret.etag = format_etag(h.digest());
+          }
+          if (!ret.FindHeader("ETag"))
+            ret.headers.emplace_back("ETag", "\"" + ret.etag + "\"");
+          if (ret.lastModified > 0 && !ret.FindHeader("Last-Modified"))
+            ret.headers.emplace_back("Last-Modified", format_http_date(ret.lastModified));
+        }
+      }
+
+      // The response as a Ret, for requests that need per-request headers (e.g. CORS)
+      Ret Materialize() const { return ret; }
+
+      Ret Serve(const Ctx& ctx)
+      {
+        auto current = rendered();
+        if (ret.status == 200 && not_modified(ctx, ret.etag, ret.lastModified))
+          return Ret{.status = 304, .wire = current->notModified};
+        if (ctx.GetMethod() == Method::Head)
+          return Ret{.status = ret.status, .wire = current->head};
+        return Ret{.status = ret.status, .sharedBody = ret.sharedBody, .wire = current->full};
+      }
+
+    private:
+      struct wires
+      {
+        std::shared_ptr<const std::string> date;
+        std::shared_ptr<const std::string> full;
+        std::shared_ptr<const std::string> head;
+        std::shared_ptr<const std::string> notModified;
+      };
+
+      std::shared_ptr<const wires> rendered()
+      {
+        auto date    = HttpDate::Get();
+        auto current = cache.load();
+        if (current && current->date == date)
+          return current;
+
+        // Threads racing at a second boundary render the same bytes
+        auto next  = std::make_shared<wires>();
+        next->date = date;
+
+        std::string full;
+        WriteHead(ret, full);
+        full += ret.GetBody();
+        next->full = std::make_shared<const std::string>(std::move(full));
+
+        Ret head = ret;
+        head.sharedBody.reset();
+        if (!head.FindHeader("Content-Length"))
+          head.headers.emplace_back("Content-Length", std::to_string(ret.GetBody().size()));
+        std::string headWire;
+        WriteHead(head, headWire);
+        next->head = std::make_shared<const std::string>(std::move(headWire));
+
+        Ret notModified{.status = 304};
+        for (auto& header: ret.headers)
+          if (header.first == "ETag" || header.first == "Last-Modified" || header.first == "Cache-Control")
+            notModified.headers.push_back(header);
+        std::string notModifiedWire;
+        WriteHead(notModified, notModifiedWire);
+        next->notModified = std::make_shared<const std::string>(std::move(notModifiedWire));
+
+        cache.store(next);
+        return next;
+      }
+
+      Ret                               ret;
+      atomic_shared<const wires>        cache;
+    };
+  } // namespace details
+
+  namespace details
+  {
+    enum class Encoding : std::uint8_t
+    {
+      Identity,
+      Gzip,
+      Deflate,
+    };
+
+    inline std::string_view encoding_name(Encoding enc)
+    {
+      return enc == Encoding::Gzip ? "gzip" : enc == Encoding::Deflate ? "deflate" : "identity";
+    }
+
+    /**
+     * @brief Pick gzip over deflate from Accept-Encoding, codings with q=0 are refused
+     */
+    inline Encoding negotiate_encoding(std::string_view acceptEncoding)
+    {
+#ifdef REST_USE_ZLIB
+      bool gzip = false, deflate = false, any = false;
+      while (!acceptEncoding.empty())
+      {
+        size_t           comma = acceptEncoding.find(',');
+        std::string_view item  = acceptEncoding.substr(0, comma);
+        acceptEncoding = comma == std::string_view::npos ? std::string_view() : acceptEncoding.substr(comma + 1);
+
+        size_t           semi   = item.find(';');
+        std::string_view coding = item.substr(0, semi);
+        while (!coding.empty() && coding.front() == ' ')
+          coding.remove_prefix(1);
+        while (!coding.empty() && coding.back() == ' ')
+          coding.remove_suffix(1);
+
+        bool refused = false;
+        if (semi != std::string_view::npos)
+        {
+          std::string_view q = item.substr(semi + 1);
+          while (!q.empty() && q.front() == ' ')
+            q.remove_prefix(1);
+          refused = q.starts_with("q=0") && q.find_first_not_of("0.", 3) == std::string_view::npos;
+        }
+        if (refused)
+          continue;
+
+        if (coding == "gzip" || coding == "x-gzip")
+          gzip = true;
+        else if (coding == "deflate")
+          deflate = true;
+        else if (coding == "*")
+          any = true;
+      }
+      if (gzip || any)
+        return Encoding::Gzip;
+      if (deflate)
+        return Encoding::Deflate;
+#endif
+      return Encoding::Identity;
+    }
+
+#ifdef REST_USE_ZLIB
+    /**
+     * @brief Per thread reusable deflate state, avoids deflateInit/deflateEnd on every response
+     */
+    class compressor
+    {
+    public:
+      static compressor& local()
+      {
+        thread_local compressor instance;
+        return instance;
+      }
+
+      bool compress(Encoding enc, int level, std::string_view in, std::string& out)
+      {
+        stream& st = enc == Encoding::Gzip ? gzip : deflate;
+        if (!st.ready)
+        {
+          if (deflateInit2(&st.zs, level, Z_DEFLATED, enc == Encoding::Gzip ? 15 + 16 : 15, 8, Z_DEFAULT_STRATEGY) !=
+              Z_OK)
+            return false;
+          st.ready = true;
+          st.level = level;
+        }
+        else
+        {
+          deflateReset(&st.zs);
+          if (st.level != level && deflateParams(&st.zs, level, Z_DEFAULT_STRATEGY) == Z_OK)
+            st.level = level;
+        }
+
+        out.resize(deflateBound(&st.zs, (uLong)in.size()));
+        st.zs.next_in   = (Bytef*)in.data();
+        st.zs.avail_in  = (uInt)in.size();
+        st.zs.next_out  = (Bytef*)out.data();
+        st.zs.avail_out = (uInt)out.size();
+        if (::deflate(&st.zs, Z_FINISH) != Z_STREAM_END)
+          return false;
+        out.resize(st.zs.total_out);
+        return true;
+      }
+
+    private:
+      struct stream
+      {
+        z_stream zs{};
+        bool     ready = false;
+        int      level = 0;
+
+        ~stream()
+        {
+          if (ready)
+            deflateEnd(&zs);
+        }
+      };
+
+      stream gzip, deflate;
+    };
+#endif
+
+    inline bool compress(Encoding enc, int level, std::string_view in, std::string& out)
+    {
+#ifdef REST_USE_ZLIB
+      return enc != Encoding::Identity && compressor::local().compress(enc, level, in, out);
+#else
+      return false;
+#endif
+    }
+
+    /**
+     * @brief Per route compression state: adaptive threshold and the precompressed variant of the last response
+     */
+    struct compression_state
+    {
+      explicit compression_state(const CompressionOptions& _options): options(_options), threshold(_options.minSize) {}
+
+      /**
+       * @brief Compress a 200 response in place when the client accepts it and it is worth it
+       */
+      void apply(const Ctx& ctx, Ret& ret)
+      {
+        if (options.minSize == 0 || ret.status != 200 || !ret.filePath.empty() || ret.FindHeader("Content-Encoding"))
+          return;
+
+        size_t size = ret.BodySize();
+        if (size < options.minSize)
+          return;
+        ret.headers.emplace_back("Vary", "Accept-Encoding");
+        // Every probeEvery-th body under the threshold is compressed anyway, so it can come back down
+        if (size < threshold.load(std::memory_order_relaxed) &&
+            skipped.fetch_add(1, std::memory_order_relaxed) % probeEvery != probeEvery - 1)
+          return;
+
+        Encoding enc = negotiate_encoding(ctx.GetHeader("Accept-Encoding"));
+        if (enc == Encoding::Identity)
+          return;
+
+        std::shared_ptr<const std::string> compressed;
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          if (cached && !ret.etag.empty() && cachedEtag == ret.etag && cachedEncoding == enc)
+            compressed = cached;
+        }
+        // A cached body is a known good sample
+        if (compressed)
+          adapt(size, compressed->size());
+
+        if (!compressed)
+        {
+          // The compressor takes the body in one piece
+          ret.Flatten();
+          std::string_view body = ret.GetBody();
+          auto             out  = std::make_shared<std::string>();
+          if (!compress(enc, options.level, body, *out))
+            return;
+          adapt(body.size(), out->size());
+          if (out->size() >= body.size())
+            return;
+          compressed = std::move(out);
+
+          if (!ret.etag.empty())
+          {
+            std::lock_guard<std::mutex> lock(mtx);
+            cached         = compressed;
+            cachedEtag     = ret.etag;
+            cachedEncoding = enc;
+          }
+        }
+
+        ret.ClearBody();
+        ret.sharedBody = std::move(compressed);
+        ret.headers.emplace_back("Content-Encoding", std::string(encoding_name(enc)));
+        for (auto& [key, value]: ret.headers)
+          if (key == "ETag" && !ret.etag.empty())
+            value = "\"" + ret.etag + "-" + std::string(encoding_name(enc)) + "\"";
+      }
+
+    private:
+      static constexpr size_t maxThreshold = 1 << 20;
+      static constexpr size_t probeEvery   = 16;
+
+      /**
+       * @brief A poor ratio moves the threshold above that body, a good one halves it
+       */
+      void adapt(size_t in, size_t out)
+      {
+        size_t cur = threshold.load(std::memory_order_relaxed);
+        if (out > in / 8 * 7)
+          threshold.store(std::max(cur, std::min(in * 2, maxThreshold)), std::memory_order_relaxed);
+        else if (out < in / 2 && cur > options.minSize)
+          threshold.store(std::max(cur / 2, options.minSize), std::memory_order_relaxed);
+      }
+
+      CompressionOptions  options;
+      std::atomic<size_t> threshold;
+      std::atomic<size_t> skipped{0};
+
+      std::mutex                         mtx;
+      std::shared_ptr<const std::string> cached;
+      std::string                        cachedEtag;
+      Encoding                           cachedEncoding = Encoding::Identity;
+    };
+
+    /**
+     * @brief Header block of the last GET of a versioned route, per negotiated encoding, after compression and with
+     * @brief its Content-Length, so HEAD gets the same headers as GET without invoking the handler
+     */
+    class head_cache
+    {
+    public:
+      static Encoding encoding(const Ctx& ctx) { return negotiate_encoding(ctx.GetHeader("Accept-Encoding")); }
+
+      bool contains(const Ctx& ctx, std::string_view etag) const
+      {
+        auto block = blocks[size_t(encoding(ctx))].load();
+        return block && block->etag == etag;
+      }
+
+      void store(const Ctx& ctx, const Ret& ret)
+      {
+        auto block  = std::make_shared<head_block>();
+        block->etag = ret.etag;
+        block->headers = ret.headers;
+        if (!ret.FindHeader("Content-Length"))
+          block->headers.emplace_back("Content-Length", std::to_string(ret.BodySize()));
+        blocks[size_t(encoding(ctx))].store(std::move(block));
+      }
+
+      /**
+       * @brief The cached block replaces headers of the same name, the others of ret, e.g. added by middleware, stay
+       */
+      bool merge(const Ctx& ctx, Ret& ret) const
+      {
+        auto block = blocks[size_t(encoding(ctx))].load();
+        if (!block || block->etag != ret.etag)
+          return false;
+
+        auto headers = block->headers;
+        for (auto& header: ret.headers)
+        {
+          bool cached = std::any_of(block->headers.begin(), block->headers.end(),
+                                    [&header](auto& other) { return other.first == header.first; });
+          if (!cached)
+            headers.push_back(std::move(header));
+        }
+        ret.headers = std::move(headers);
+        return true;
+      }
+
+    private:
+      struct head_block
+      {
+        std::string                                      etag;
+        std::vector<std::pair<std::string, std::string>> headers;
+      };
+
+      std::array<atomic_shared<const head_block>, 3> blocks;
+    };
+  } // namespace details
+
+  namespace details
+  {
+    inline int hex_value(char c)
+    {
+      if (c >= '0' && c <= '9')
+        return c - '0';
+      if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+      if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+      return -1;
+    }
+
+    /**
+     * @brief Percent-decode, false on malformed escapes
+     */
+    inline bool url_decode(std::string_view src, std::string& out)
+    {
+      out.clear();
+      out.reserve(src.size());
+      for (size_t i = 0; i < src.size(); ++i)
+      {
+        if (src[i] != '%')
+        {
+          out.push_back(src[i]);
+          continue;
+        }
+        if (i + 2 >= src.size())
+          return false;
+        int hi = hex_value(src[i + 1]), lo = hex_value(src[i + 2]);
+        if (hi < 0 || lo < 0)
+          return false;
+        out.push_back(char(hi << 4 | lo));
+        i += 2;
+      }
+      return true;
+    }
+
+    /**
+     * @brief Parse a single "bytes=first-last" / "bytes=first-" / "bytes=-suffix" range
+     * @return 1: satisfiable range, 0: unsatisfiable (416), -1: absent, malformed or multiple ranges (serve whole)
+     */
+    inline int parse_range(std::string_view src, std::uint64_t size, std::uint64_t& first, std::uint64_t& last)
+    {
+      if (!src.starts_with("bytes=") || src.find(',') != std::string_view::npos)
+        return -1;
+      src.remove_prefix(6);
+
+      size_t dash = src.find('-');
+      if (dash == std::string_view::npos)
+        return -1;
+
+      auto parse = [](std::string_view s, std::uint64_t& v)
+      { return !s.empty() && std::from_chars(s.data(), s.data() + s.size(), v).ptr == s.data() + s.size(); };
+
+      std::string_view a = src.substr(0, dash), b = src.substr(dash + 1);
+      if (a.empty())
+      {
+        std::uint64_t suffix;
+        if (!parse(b, suffix))
+          return -1;
+        if (suffix == 0 || size == 0)
+          return 0;
+        first = suffix >= size ? 0 : size - suffix;
+        last  = size - 1;
+        return 1;
+      }
+
+      if (!parse(a, first))
+        return -1;
+      if (b.empty())
+        last = size - 1;
+      else if (!parse(b, last) || last < first)
+        return -1;
+
+      if (first >= size)
+        return 0;
+      last = std::min(last, size - 1);
+      return 1;
+    }
+
+    inline std::string_view mime_type(std::string_view path)
+    {
+      static const std::pair<std::string_view, std::string_view> types[] = {
+          {".html", "text/html; charset=utf-8"       },
+          {".htm",  "text/html; charset=utf-8"       },
+          {".css",  "text/css; charset=utf-8"        },
+          {".js",   "text/javascript; charset=utf-8" },
+          {".json", "application/json"               },
+          {".txt",  "text/plain; charset=utf-8"      },
+          {".xml",  "application/xml"                },
+          {".svg",  "image/svg+xml"                  },
+          {".png",  "image/png"                      },
+          {".jpg",  "image/jpeg"                     },
+          {".jpeg", "image/jpeg"                     },
+          {".gif",  "image/gif"                      },
+          {".webp", "image/webp"                     },
+          {".ico",  "image/x-icon"                   },
+          {".woff", "font/woff"                      },
+          {".woff2", "font/woff2"                    },
+          {".wasm", "application/wasm"               },
+          {".pdf",  "application/pdf"                },
+      };
+
+      size_t dot = path.rfind('.');
+      if (dot != std::string_view::npos && path.find('/', dot) == std::string_view::npos)
+        for (auto& [ext, type]: types)
+          if (path.substr(dot) == ext)
+            return type;
+      return "application/octet-stream";
+    }
+  } // namespace details
+
+  struct StaticOptions
+  {
+    // Total bytes of file content kept in memory
+    size_t cacheBudget = 64 << 20;
+    // Larger files are not cached but served zero-copy through Ret::filePath (sendfile)
+    size_t maxCachedFileSize = 256 << 10;
+    // Cached entries are re-validated with stat() once this interval elapsed
+    std::chrono::milliseconds revalidateInterval = std::chrono::seconds(1);
+    // Served for directory requests
+    std::string indexFile = "index.html";
+    // Precompressed variants of cached text files are built once, so the best level is affordable
+    CompressionOptions compression = {.minSize = 256, .level = 9};
+  };
+
+  /**
+   * @brief Static file server behind RegisterStatic
+   * @brief Small hot files are kept in a byte-budgeted LRU together with their precomputed headers,
+   * @brief large files are handed to the transport for sendfile(), single byte ranges are answered with 206
+   */
+  class StaticFiles
+  {
+  public:
+    StaticFiles(std::filesystem::path _root, StaticOptions _options)
+        : root(std::move(_root)), options(std::move(_options))
+    {
+    }
+
+    Ret Serve(const Ctx& ctx, std::string_view rawPath)
+    {
+      std::string relPath;
+      if (!details::url_decode(rawPath, relPath) || !safe(relPath))
+        return {.status = 400};
+
+      auto entry = acquire(relPath);
+      if (!entry)
+        return {.status = 404};
+
+      if (details::not_modified(ctx, entry->etag, entry->lastModified))
+        return {.status = 304, .headers = entry->headers};
+
+      Ret ret{.status = 200, .headers = entry->headers, .etag = entry->etag, .lastModified = entry->lastModified};
+
+      std::uint64_t first = 0, last = entry->size ? entry->size - 1 : 0;
+      int           range = -1;
+
+      std::string_view rangeHeader = ctx.GetHeader("Range");
+      std::string_view ifRange     = ctx.GetHeader("If-Range");
+      if (!rangeHeader.empty() && (ifRange.empty() || ifRange == entry->quotedEtag))
+        range = details::parse_range(rangeHeader, entry->size, first, last);
+
+      if (range == 0)
+      {
+        ret.status = 416;
+        ret.headers.emplace_back("Content-Range", "bytes */" + std::to_string(entry->size));
+        return ret;
+      }
+      if (range == 1)
+      {
+        ret.status = 206;
+        ret.headers.emplace_back("Content-Range", "bytes " + std::to_string(first) + "-" + std::to_string(last) +
+                                                      "/" + std::to_string(entry->size));
+      }
+
+      if (entry->content)
+      {
+        if (range == 1)
+          ret.body = entry->content->substr(first, last - first + 1);
+        else
+          ret.sharedBody = variant(ctx, *entry, ret);
+      }
+      else if (entry->size)
+      {
+        ret.filePath   = entry->path.string();
+        ret.fileOffset = first;
+        ret.fileLength = last - first + 1;
+      }
+      return ret;
+    }
+
+  private:
+    struct Entry
+    {
+      std::string                     key;
+      std::filesystem::path           path;
+      std::filesystem::file_time_type mtime;
+      std::uint64_t                   size;
+      std::time_t                     lastModified;
+      std::string                     etag;
+      std::string                     quotedEtag;
+
+      // Content-Type, Accept-Ranges, ETag, Last-Modified
+      std::vector<std::pair<std::string, std::string>> headers;
+
+      // nullptr for files larger than maxCachedFileSize
+      std::shared_ptr<const std::string> content;
+      bool                               compressible;
+
+      // Guarded by StaticFiles::mtx, built on first request accepting them
+      std::shared_ptr<const std::string> gzip, deflate;
+
+      // Guarded by StaticFiles::mtx
+      std::chrono::steady_clock::time_point checkedAt;
+    };
+    using Lru = std::list<std::pair<std::string, std::shared_ptr<Entry>>>;
+
+    static bool safe(std::string_view path)
+    {
+      if (path.find('\0') != std::string_view::npos || path.find('\\') != std::string_view::npos)
+        return false;
+      while (!path.empty())
+      {
+        size_t           slash   = path.find('/');
+        std::string_view segment = path.substr(0, slash);
+        if (segment == "..")
+          return false;
+        path = slash == std::string_view::npos ? std::string_view() : path.substr(slash + 1);
+      }
+      return true;
+    }
+
+    static size_t cost(const Entry& entry)
+    {
+      size_t ret = sizeof(Entry);
+      for (auto* body: {&entry.content, &entry.gzip, &entry.deflate})
+        ret += *body ? (*body)->size() : 0;
+      return ret;
+    }
+
+    /**
+     * @brief Cached body, or its precompressed variant when the client accepts one
+     */
+    std::shared_ptr<const std::string> variant(const Ctx& ctx, Entry& entry, Ret& ret)
+    {
+      if (!entry.compressible || options.compression.minSize == 0 || entry.size < options.compression.minSize)
+        return entry.content;
+
+      ret.headers.emplace_back("Vary", "Accept-Encoding");
+      details::Encoding enc = details::negotiate_encoding(ctx.GetHeader("Accept-Encoding"));
+      if (enc == details::Encoding::Identity)
+        return entry.content;
+
+      auto&                              slot = enc == details::Encoding::Gzip ? entry.gzip : entry.deflate;
+      std::shared_ptr<const std::string> body;
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        body = slot;
+      }
+      if (!body)
+      {
+        auto out = std::make_shared<std::string>();
+        if (!details::compress(enc, options.compression.level, *entry.content, *out))
+          return entry.content;
+        // Keep an empty marker for incompressible files so they are not retried
+        if (out->size() >= entry.content->size())
+          out->clear();
+
+        std::lock_guard<std::mutex> lock(mtx);
+        if (!slot)
+        {
+          slot    = out;
+          auto it = index.find(entry.key);
+          if (it != index.end() && it->second->second.get() == &entry)
+          {
+            used += out->size();
+            // The entry was just moved to the front by acquire, so it is evicted last
+            while (used > options.cacheBudget && lru.size() > 1)
+              erase(index.find(lru.back().first));
+          }
+        }
+        body = slot;
+      }
+      if (body->empty())
+        return entry.content;
+
+      ret.headers.emplace_back("Content-Encoding", std::string(details::encoding_name(enc)));
+      for (auto& [key, value]: ret.headers)
+        if (key == "ETag")
+          value = "\"" + entry.etag + "-" + std::string(details::encoding_name(enc)) + "\"";
+      return body;
+    }
+
+    std::shared_ptr<Entry> acquire(const std::string& relPath)
+    {
+      auto now = std::chrono::steady_clock::now();
+      {
+        std::lock_guard<std::mutex> lock(mtx);
+        auto                        it = index.find(relPath);
+        if (it != index.end())
+        {
+          lru.splice(lru.begin(), lru, it->second);
+          auto entry = it->second->second;
+          if (now - entry->checkedAt < options.revalidateInterval)
+            return entry;
+        }
+      }
+
+      std::error_code       ec;
+      std::filesystem::path path = root / std::filesystem::path(relPath).relative_path();
+      if (std::filesystem::is_directory(path, ec))
+        path /= options.indexFile;
+
+      auto status = std::filesystem::status(path, ec);
+      auto mtime  = std::filesystem::last_write_time(path, ec);
+      auto size   = ec || !std::filesystem::is_regular_file(status) ? 0 : std::filesystem::file_size(path, ec);
+
+      std::lock_guard<std::mutex> lock(mtx);
+      auto                        it = index.find(relPath);
+      if (ec || !std::filesystem::is_regular_file(status))
+      {
+        if (it != index.end())
+          erase(it);
+        return nullptr;
+      }
+      if (it != index.end() && it->second->second->mtime == mtime && it->second->second->size == size)
+      {
+        it->second->second->checkedAt = now;
+        return it->second->second;
+      }
+
+      auto entry = load(path, mtime, size);
+      if (!entry)
+        return nullptr;
+      entry->key       = relPath;
+      entry->checkedAt = now;
+
+      if (it != index.end())
+        erase(it);
+      lru.emplace_front(relPath, entry);
+      index[relPath] = lru.begin();
+      used += cost(*entry);
+      while (used > options.cacheBudget && lru.size() > 1)
+        erase(index.find(lru.back().first));
+
+      return entry;
+    }
+
+    std::shared_ptr<Entry> load(const std::filesystem::path& path, std::filesystem::file_time_type mtime,
+                                std::uint64_t size)
+    {
+      auto entry   = std::make_shared<Entry>();
+      entry->path  = path;
+      entry->mtime = mtime;
+      entry->size  = size;
+
+      auto sys = std::chrono::time_point_cast<std::chrono::seconds>(mtime - std::filesystem::file_time_type::clock::now() +
+                                                                    std::chrono::system_clock::now());
+      entry->lastModified = std::chrono::system_clock::to_time_t(sys);
+
+      if (size <= options.maxCachedFileSize)
+      {
+        std::ifstream file(path, std::ios::binary);
+        auto          content = std::make_shared<std::string>(size, '\0');
+        if (!file.read(content->data(), (std::streamsize)size))
+          return nullptr;
+        entry->content = std::move(content);
+      }
+
+      // Like nginx: derived from mtime and size, files never need to be hashed
+      std::uint64_t  raw = (std::uint64_t)mtime.time_since_epoch().count();
+      details::hasher h;
+      h.update(std::string_view((const char*)&raw, sizeof(raw)));
+      h.update(std::string_view((const char*)&size, sizeof(size)));
+      entry->etag       = details::format_etag(h.digest());
+      entry->quotedEtag = "\"" + entry->etag + "\"";
+
+      std::string_view type = details::mime_type(path.string());
+      entry->compressible   = type.starts_with("text/") || type == "application/json" ||
+                            type == "application/xml" || type == "image/svg+xml" || type == "application/wasm";
+
+      entry->headers = {
+          {"Content-Type",  std::string(details::mime_type(path.string()))},
+          {"Accept-Ranges", "bytes"                                      },
+          {"ETag",          entry->quotedEtag                              },
+          {"Last-Modified", details::format_http_date(entry->lastModified)},
+      };
+      return entry;
+    }
+
+    void erase(std::unordered_map<std::string, Lru::iterator>::iterator it)
+    {
+      used -= cost(*it->second->second);
+      lru.erase(it->second);
+      index.erase(it);
+    }
+
+    std::filesystem::path root;
+    StaticOptions         options;
+
+    std::mutex                                      mtx;
+    Lru                                             lru;
+    std::unordered_map<std::string, Lru::iterator> index;
+    size_t                                          used = 0;
+  };
+
+  struct SchedulingOptions
+  {
+    // Always serve the highest non-empty class first, otherwise classes share workers by weight
+    bool strict = false;
+    // Relative share of Interactive, Normal and Bulk when not strict
+    std::array<unsigned, 3> weights = {8, 4, 1};
+  };
+
+  struct AdmissionOptions
+  {
+    bool enabled = false;
+    // Acceptable standing queue delay of Interactive, Normal and Bulk work
+    std::array<std::chrono::microseconds, 3> target = {std::chrono::milliseconds(5), std::chrono::milliseconds(20),
+                                                       std::chrono::milliseconds(500)};
+    // How long the delay must stay above target before new work is rejected, also the scale of the drop spacing
+    // interval / sqrt(count): requests take milliseconds, so a short one lets the rejections catch up with an open-loop
+    // overload within a fraction of a second, CoDel's 100ms (a network round trip) would take tens of seconds
+    std::chrono::milliseconds interval = std::chrono::milliseconds(5);
+    // Sent as Retry-After with the 503
+    std::chrono::seconds retryAfter = std::chrono::seconds(1);
+  };
+
+  /**
+   * @brief CoDel admission control of one run queue
+   * @brief Fed with the standing queue delay at every dequeue: once it stayed above target for a whole interval the
+   * @brief controller starts dropping, rejecting one new task every interval / sqrt(count) so the rate ramps up until
+   * @brief the delay falls below target, re-entering soon after keeps most of the count, as in the CoDel control law
+   */
+  class AdmissionController
+  {
+  public:
+    void Configure(std::chrono::nanoseconds _target, std::chrono::nanoseconds _interval)
+    {
+      target   = _target.count();
+      interval = _interval.count();
+    }
+
+    void OnDequeue(std::uint64_t sojourn, std::chrono::steady_clock::time_point now)
+    {
+      std::int64_t ts = now.time_since_epoch().count();
+      if (sojourn < target)
+      {
+        firstAbove.store(0, std::memory_order_relaxed);
+        dropping.store(false, std::memory_order_relaxed);
+        return;
+      }
+
+      std::int64_t first = firstAbove.load(std::memory_order_relaxed);
+      if (first == 0)
+      {
+        firstAbove.compare_exchange_strong(first, ts + interval, std::memory_order_relaxed);
+        return;
+      }
+      if (ts < first || dropping.load(std::memory_order_relaxed))
+        return;
+
+      // Above target for a whole interval, start dropping now
+      std::lock_guard<std::mutex> lock(mtx);
+      if (dropping.load(std::memory_order_relaxed))
+        return;
+      std::uint64_t n = count.load(std::memory_order_relaxed);
+      n = n > 2 && ts - dropNext.load(std::memory_order_relaxed) < 16 * interval ? n - 2 : 1;
+      count.store(n, std::memory_order_relaxed);
+      dropNext.store(ts, std::memory_order_relaxed);
+      dropping.store(true, std::memory_order_relaxed);
+    }
+
+    bool Admit(size_t depth, std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now())
+    {
+      if (!dropping.load(std::memory_order_relaxed))
+        return true;
+      // Nothing left to dequeue, so nothing would ever clear the state
+      if (depth == 0)
+      {
+        firstAbove.store(0, std::memory_order_relaxed);
+        dropping.store(false, std::memory_order_relaxed);
+        return true;
+      }
+
+      // The next drop is scheduled from the previous one, so a late check catches up with several rejections
+      std::int64_t next = dropNext.load(std::memory_order_relaxed);
+      if (now.time_since_epoch().count() < next)
+        return true;
+      std::uint64_t n = count.load(std::memory_order_relaxed) + 1;
+      if (!dropNext.compare_exchange_strong(next, next + std::int64_t(interval / std::sqrt(double(n))),
+                                            std::memory_order_relaxed))
+        return true;
+      count.store(n, std::memory_order_relaxed);
+      return false;
+    }
+
+  private:
+    std::uint64_t              target   = 0;
+    std::int64_t               interval = 0;
+    std::atomic<std::int64_t>  firstAbove{0};
+    std::atomic<bool>          dropping{false};
+    std::atomic<std::uint64_t> count{0};
+    std::atomic<std::int64_t>  dropNext{0};
+    // Only serializes entering the dropping state
+    std::mutex mtx;
+  };
+
+  /**
+   * @brief Queueing statistics of one priority class
+   */
+  struct PriorityStats
+  {
+    size_t                   depth    = 0;
+    std::uint64_t            executed = 0;
+    std::chrono::nanoseconds avgWait{0};
+    std::chrono::nanoseconds maxWait{0};
+    // Upper bound of the power of two bucket holding the 99th percentile
+    std::chrono::nanoseconds p99Wait{0};
+  };
+
+  /**
+   * @brief Work-stealing thread pool for CPU-heavy handlers
+   * @brief Each worker owns one run queue per priority class, popped LIFO by its owner until the oldest task reaches
+   * @brief the class target and FIFO from then on, idle workers steal the oldest task of another
+   */
+  class WorkerPool
+  {
+  public:
+    using Task = std::function<void()>;
+
+    explicit WorkerPool(size_t threads = 0, SchedulingOptions _scheduling = {}, AdmissionOptions _admission = {})
+        : scheduling(_scheduling), admission(_admission)
+    {
+      if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+      for (size_t cls = 0; cls < classes; ++cls)
+        controllers[cls].Configure(admission.target[cls], admission.interval);
+
+      // e.g. weights 2:1:1 -> I N B I, each worker walks it from a different offset
+      interleave();
+
+      for (size_t i = 0; i < threads; ++i)
+        workers.push_back(std::make_unique<Worker>());
+      for (size_t i = 0; i < threads; ++i)
+      {
+        workers[i]->cursor = i * schedule.size() / threads;
+        workers[i]->thread = std::thread([this, i] { run(i); });
+      }
+    }
+
+    WorkerPool(const WorkerPool&)            = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    ~WorkerPool()
+    {
+      {
+        std::lock_guard<std::mutex> lock(sleepMtx);
+        stop = true;
+      }
+      sleepCv.notify_all();
+      for (auto& worker: workers)
+        worker->thread.join();
+    }
+
+    size_t Size() const { return workers.size(); }
+
+    /**
+     * @brief Tasks submitted from a worker stay on its own queues, others are spread round robin
+     */
+    void Submit(Task task, Priority priority = Priority::Normal)
+    {
+      size_t cls = size_t(priority);
+      size_t idx = currentPool == this ? currentIndex : next.fetch_add(1, std::memory_order_relaxed) % workers.size();
+      // Counted before the push, so the worker that takes it never decrements below zero
+      stats[cls].depth.fetch_add(1, std::memory_order_relaxed);
+      pending.fetch_add(1, std::memory_order_release);
+      {
+        std::lock_guard<std::mutex> lock(workers[idx]->mtx);
+        workers[idx]->tasks[cls].push_back({std::move(task), std::chrono::steady_clock::now()});
+      }
+      {
+        std::lock_guard<std::mutex> lock(sleepMtx);
+      }
+      sleepCv.notify_one();
+    }
+
+    /**
+     * @brief Run one queued task on the calling thread, for threads waiting on work they submitted
+     * @return false if nothing was queued
+     */
+    bool RunPendingTask()
+    {
+      Job job;
+      if (!take(currentPool == this ? currentIndex : 0, job))
+        return false;
+      execute(job);
+      return true;
+    }
+
+    /**
+     * @brief Whether the calling thread is one of this pool's workers
+     */
+    bool IsWorkerThread() const { return currentPool == this; }
+
+    /**
+     * @brief Whether new work of this class should be accepted, always true unless admission control is enabled
+     */
+    bool Admit(Priority priority)
+    {
+      size_t cls = size_t(priority);
+      return !admission.enabled || controllers[cls].Admit(stats[cls].depth.load(std::memory_order_relaxed));
+    }
+
+    const AdmissionOptions& GetAdmissionOptions() const { return admission; }
+
+    PriorityStats Stats(Priority priority) const
+    {
+      const ClassStats& st = stats[size_t(priority)];
+      PriorityStats     ret;
+      ret.depth    = st.depth.load(std::memory_order_relaxed);
+      ret.executed = st.executed.load(std::memory_order_relaxed);
+      ret.maxWait  = std::chrono::nanoseconds(st.maxWait.load(std::memory_order_relaxed));
+      if (ret.executed)
+        ret.avgWait = std::chrono::nanoseconds(st.totalWait.load(std::memory_order_relaxed) / ret.executed);
+
+      std::uint64_t seen = 0;
+      for (size_t i = 0; i < st.histogram.size(); ++i)
+      {
+        seen += st.histogram[i].load(std::memory_order_relaxed);
+        if (ret.executed && seen * 100 >= ret.executed * 99)
+        {
+          ret.p99Wait = std::chrono::nanoseconds(std::uint64_t(1) << (i + 1));
+          break;
+        }
+      }
+      return ret;
+    }
+
+  private:
+    static constexpr size_t classes = 3;
+
+    struct Job
+    {
+      Task                                  task;
+      std::chrono::steady_clock::time_point queuedAt;
+    };
+
+    struct Worker
+    {
+      std::mutex      mtx;
+      std::deque<Job> tasks[classes];
+      std::thread     thread;
+      // Position in the weighted schedule, only touched by the owning thread
+      size_t cursor = 0;
+    };
+
+    struct ClassStats
+    {
+      std::atomic<size_t>                       depth{0};
+      std::atomic<std::uint64_t>                executed{0};
+      std::atomic<std::uint64_t>                totalWait{0};
+      std::atomic<std::uint64_t>                maxWait{0};
+      std::array<std::atomic<std::uint64_t>, 64> histogram{};
+    };
+
+    // Worker identity of the calling thread
+    static inline thread_local WorkerPool* currentPool  = nullptr;
+    static inline thread_local size_t      currentIndex = 0;
+
+    /**
+     * @brief Spread each class evenly over the schedule, so a high weight does not mean a long burst
+     */
+    void interleave()
+    {
+      std::vector<std::pair<double, Priority>> slots;
+      for (size_t cls = 0; cls < classes; ++cls)
+      {
+        unsigned weight = std::max(1u, scheduling.weights[cls]);
+        for (unsigned i = 0; i < weight; ++i)
+          slots.emplace_back((i + 0.5) / weight, Priority(cls));
+      }
+      std::stable_sort(slots.begin(), slots.end(), [](auto& a, auto& b) { return a.first < b.first; });
+      schedule.clear();
+      for (auto& [_, cls]: slots)
+        schedule.push_back(cls);
+    }
+
+    /**
+     * @brief The owner takes its newest task, still warm in cache, while the oldest one waited less than the class
+     * @brief target, FIFO beyond that so no task starves under sustained load, thieves take the oldest one of a victim
+     * @brief oldest is when the oldest task of that queue was queued, the standing queue signal for CoDel
+     */
+    bool takeClass(size_t self, size_t cls, Job& job, std::chrono::steady_clock::time_point& oldest)
+    {
+      {
+        std::lock_guard<std::mutex> lock(workers[self]->mtx);
+        auto&                       tasks = workers[self]->tasks[cls];
+        if (!tasks.empty())
+        {
+          oldest = tasks.front().queuedAt;
+          if (std::chrono::steady_clock::now() - oldest < admission.target[cls])
+          {
+            job = std::move(tasks.back());
+            tasks.pop_back();
+          }
+          else
+          {
+            job = std::move(tasks.front());
+            tasks.pop_front();
+          }
+          return true;
+        }
+      }
+      for (size_t i = 1; i < workers.size(); ++i)
+      {
+        // A busy victim is skipped, pending stays non-zero so the caller rescans instead of sleeping
+        Worker&                      victim = *workers[(self + i) % workers.size()];
+        std::unique_lock<std::mutex> lock(victim.mtx, std::try_to_lock);
+        if (lock.owns_lock() && !victim.tasks[cls].empty())
+        {
+          oldest = victim.tasks[cls].front().queuedAt;
+          job    = std::move(victim.tasks[cls].front());
+          victim.tasks[cls].pop_front();
+          return true;
+        }
+      }
+      return false;
+    }
+
+    bool take(size_t self, Job& job)
+    {
+      size_t first = 0;
+      if (!scheduling.strict && currentPool == this)
+      {
+        Worker& worker = *workers[self];
+        first          = size_t(schedule[worker.cursor]);
+        worker.cursor  = (worker.cursor + 1) % schedule.size();
+      }
+
+      // The scheduled class first, then the others by priority, so no worker idles while work is queued
+      for (size_t i = 0; i <= classes; ++i)
+      {
+        size_t                                cls = i == 0 ? first : i - 1;
+        std::chrono::steady_clock::time_point oldest;
+        if ((i == 0 || cls != first) && takeClass(self, cls, job, oldest))
+        {
+          account(cls, job, oldest);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    void account(size_t cls, const Job& job, std::chrono::steady_clock::time_point oldest)
+    {
+      pending.fetch_sub(1, std::memory_order_relaxed);
+
+      ClassStats&   st   = stats[cls];
+      auto          now  = std::chrono::steady_clock::now();
+      std::uint64_t wait = std::chrono::duration_cast<std::chrono::nanoseconds>(now - job.queuedAt).count();
+      // A LIFO pop hides a standing queue from the wait of the task taken, the oldest one still shows it
+      if (admission.enabled)
+        controllers[cls].OnDequeue(std::chrono::duration_cast<std::chrono::nanoseconds>(now - oldest).count(), now);
+      st.depth.fetch_sub(1, std::memory_order_relaxed);
+      st.executed.fetch_add(1, std::memory_order_relaxed);
+      st.totalWait.fetch_add(wait, std::memory_order_relaxed);
+
+      std::uint64_t maxWait = st.maxWait.load(std::memory_order_relaxed);
+      while (wait > maxWait && !st.maxWait.compare_exchange_weak(maxWait, wait, std::memory_order_relaxed))
+        ;
+
+      size_t bucket = wait ? std::bit_width(wait) - 1 : 0;
+      st.histogram[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief A throwing task must not take its worker down, Apis already turns handler exceptions into a 500
+     */
+    static void execute(Job& job)
+    {
+      try
+      {
+        job.task();
+      }
+      catch (...)
+      {
+      }
+    }
+
+    void run(size_t self)
+    {
+      currentPool  = this;
+      currentIndex = self;
+      for (;;)
+      {
+        Job job;
+        if (take(self, job))
+        {
+          execute(job);
+          continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleepMtx);
+        if (stop)
+          return;
+        sleepCv.wait(lock, [this] { return stop || pending.load(std::memory_order_acquire) > 0; });
+      }
+    }
+
+    SchedulingOptions     scheduling;
+    std::vector<Priority> schedule;
+
+    AdmissionOptions    admission;
+    AdmissionController controllers[classes];
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::atomic<size_t>                  next{0};
+    std::atomic<size_t>                  pending{0};
+    ClassStats                           stats[classes];
+
+    std::mutex              sleepMtx;
+    std::condition_variable sleepCv;
+    bool                    stop = false;
+  };
+
+  /**
+   * @brief A finished offloaded request, token identifies the connection on the owning I/O loop
+   */
+  struct Completion
+  {
+    std::uint64_t token;
+    Ret           ret;
+  };
+
+  /**
+   * @brief Lock-free MPSC queue (Vyukov) carrying offloaded responses back to the owning I/O loop
+   * @brief Any thread may Push, only the loop thread may Pop
+   */
+  class CompletionQueue
+  {
+  public:
+    CompletionQueue(): head(&stub), tail(&stub) {}
+
+    CompletionQueue(const CompletionQueue&)            = delete;
+    CompletionQueue& operator=(const CompletionQueue&) = delete;
+
+    ~CompletionQueue()
+    {
+      while (Pop())
+        ;
+    }
+
+    // Called after every Push, e.g. to write an eventfd watched by the loop
+    std::function<void()> notify;
+
+    void Push(Completion completion)
+    {
+      push(new Node{{}, std::move(completion)});
+      if (notify)
+        notify();
+    }
+
+    std::optional<Completion> Pop()
+    {
+      Node* t    = tail;
+      Node* next = t->next.load(std::memory_order_acquire);
+      if (t == &stub)
+      {
+        if (!next)
+          return std::nullopt;
+        tail = next;
+        t    = next;
+        next = next->next.load(std::memory_order_acquire);
+      }
+      if (!next)
+      {
+        // A producer is between exchange and link, or t is the last node
+        if (t != head.load(std::memory_order_acquire))
+          return std::nullopt;
+        push(&stub);
+        next = t->next.load(std::memory_order_acquire);
+        if (!next)
+          return std::nullopt;
+      }
+      tail = next;
+      std::optional<Completion> ret(std::move(t->value));
+      delete t;
+      return ret;
+    }
+
+  private:
+    struct Node
+    {
+      std::atomic<Node*> next{nullptr};
+      Completion         value;
+    };
+
+    void push(Node* node)
+    {
+      node->next.store(nullptr, std::memory_order_relaxed);
+      Node* prev = head.exchange(node, std::memory_order_acq_rel);
+      prev->next.store(node, std::memory_order_release);
+    }
+
+    Node               stub{};
+    std::atomic<Node*> head;
+    Node*              tail;
+  };
+
+  /**
+   * @brief Lock-free token buckets, implemented as GCRA: each bucket is a single atomic "theoretical arrival time"
+   * @brief Keyed buckets live in a sharded set-associative table of fixed size, a missing key takes a free way
+   * @brief of its set or evicts one with CLOCK second chance, so idle keys go first and memory stays bounded
+   * @brief Keys are identified by their 64-bit hash only, a collision shares a bucket
+   */
+  class RateLimiter
+  {
+  public:
+    explicit RateLimiter(const RateLimitOptions& _options): options(_options)
+    {
+      double burst = options.burst > 0 ? options.burst : std::max(1.0, options.rate);
+      period       = std::int64_t(1e9 / options.rate);
+      tolerance    = std::int64_t(period * burst);
+
+      if (options.key != RateLimitKey::Route)
+      {
+        size_t perShard = std::max<size_t>(ways, std::bit_ceil(std::max<size_t>(1, options.maxKeys / shardCount)));
+        for (auto& shard: shards)
+        {
+          shard.slots = std::make_unique<Slot[]>(perShard);
+          shard.mask  = perShard - 1;
+        }
+      }
+    }
+
+    /**
+     * @return 0 if allowed, otherwise nanoseconds until the next request would be
+     */
+    std::int64_t Acquire(const Ctx& ctx)
+    {
+      std::int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+      if (options.key == RateLimitKey::Route)
+        return acquire(routeTat, now);
+
+      std::string_view key;
+      if (options.key == RateLimitKey::ClientIp)
+        key = ctx.GetRemoteAddress();
+      else if (options.key == RateLimitKey::Header)
+        key = ctx.GetHeader(options.keyName);
+      else
+        key = const_cast<Ctx&>(ctx).GetUrlParam(options.keyName);
+
+      details::hasher h;
+      h.update(key);
+      std::uint64_t hash = h.digest() | 1; // 0 marks a free slot
+      return acquire(slot(hash).tat, now);
+    }
+
+  private:
+    static constexpr size_t shardCount = 16;
+    static constexpr size_t ways       = 8;
+
+    struct Slot
+    {
+      std::atomic<std::uint64_t> key{0};
+      std::atomic<std::int64_t>  tat{0};
+      std::atomic<bool>          referenced{false};
+    };
+
+    struct Shard
+    {
+      std::unique_ptr<Slot[]> slots;
+      size_t                  mask = 0;
+      // Only taken to claim or evict a slot
+      std::mutex mtx;
+      size_t     hand = 0;
+    };
+
+    std::int64_t acquire(std::atomic<std::int64_t>& tat, std::int64_t now)
+    {
+      std::int64_t cur = tat.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        std::int64_t next = std::max(cur, now) + period;
+        if (next - now > tolerance)
+          return next - now - tolerance;
+        if (tat.compare_exchange_weak(cur, next, std::memory_order_relaxed))
+          return 0;
+      }
+    }
+
+    Slot& slot(std::uint64_t hash)
+    {
+      Shard& shard = shards[hash % shardCount];
+      size_t set   = (hash / shardCount) & shard.mask & ~(ways - 1);
+
+      for (size_t i = 0; i < ways; ++i)
+      {
+        Slot& slot = shard.slots[set + i];
+        if (slot.key.load(std::memory_order_acquire) == hash)
+        {
+          if (!slot.referenced.load(std::memory_order_relaxed))
+            slot.referenced.store(true, std::memory_order_relaxed);
+          return slot;
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(shard.mtx);
+      Slot*                       victim = nullptr;
+      for (size_t i = 0; i < ways && !victim; ++i)
+      {
+        std::uint64_t key = shard.slots[set + i].key.load(std::memory_order_relaxed);
+        if (key == hash)
+          return shard.slots[set + i];
+        if (key == 0)
+          victim = &shard.slots[set + i];
+      }
+      // Second chance: a referenced way is spared once, two sweeps normally find an idle one
+      for (size_t i = 0; i < 2 * ways && !victim; ++i)
+      {
+        Slot& slot = shard.slots[set + (shard.hand++ & (ways - 1))];
+        if (!slot.referenced.exchange(false, std::memory_order_relaxed))
+          victim = &slot;
+      }
+      // Lock-free hits re-reference ways behind the sweep, a set kept hot by them still gives up the way at the hand
+      if (!victim)
+        victim = &shard.slots[set + (shard.hand++ & (ways - 1))];
+
+      victim->tat.store(0, std::memory_order_relaxed);
+      victim->referenced.store(true, std::memory_order_relaxed);
+      victim->key.store(hash, std::memory_order_release);
+      return *victim;
+    }
+
+    RateLimitOptions options;
+    std::int64_t     period;
+    std::int64_t     tolerance;
+
+    std::atomic<std::int64_t> routeTat{0};
+    Shard                     shards[shardCount];
+  };
+
+  /**
+   * @brief Suggested connection timeouts for a transport, armed on its TimerWheel
+   */
+  struct ConnectionTimeouts
+  {
+    // From accept / end of the previous response until the header block is complete (slowloris)
+    std::chrono::milliseconds headerRead = std::chrono::seconds(10);
+    // Between two body reads
+    std::chrono::milliseconds bodyRead = std::chrono::seconds(30);
+    // Idle keep-alive connection waiting for its next request
+    std::chrono::milliseconds keepAliveIdle = std::chrono::seconds(60);
+  };
+
+  /**
+   * @brief Hashed hierarchical timer wheel with O(1) arm and cancel, one per event loop and not thread safe
+   * @brief 4 levels of 256 slots cover 2^32 ticks, timers cascade to finer levels as they come due
+   * @brief Timers are nodes of intrusive lists in a recycled pool, ids carry a generation so stale ones are ignored
+   */
+  class TimerWheel
+  {
+  public:
+    using Clock    = std::chrono::steady_clock;
+    using Callback = std::function<void()>;
+    // 0 is never a valid id
+    using TimerId = std::uint64_t;
+
+    explicit TimerWheel(Clock::duration _tick = std::chrono::milliseconds(1), Clock::time_point _start = Clock::now())
+        : tick(_tick), start(_start)
+    {
+      std::fill(std::begin(heads), std::end(heads), npos);
+    }
+
+    TimerId Arm(Clock::duration after, Callback cb) { return ArmAt(Clock::now() + after, std::move(cb)); }
+
+    TimerId ArmAt(Clock::time_point when, Callback cb)
+    {
+      std::uint64_t expire = when <= start ? 0 : std::uint64_t((when - start + tick - Clock::duration(1)) / tick);
+      expire               = std::clamp(expire, current + 1, current + maxTicks);
+
+      std::uint32_t idx;
+      if (freeList != npos)
+      {
+        idx      = freeList;
+        freeList = nodes[idx].next;
+      }
+      else
+      {
+        idx = std::uint32_t(nodes.size());
+        nodes.emplace_back();
+      }
+
+      Node& node  = nodes[idx];
+      node.expire = expire;
+      node.cb     = std::move(cb);
+      link(idx);
+      ++count;
+      return TimerId(node.gen) << 32 | idx;
+    }
+
+    /**
+     * @return false if the timer already fired or was cancelled
+     */
+    bool Cancel(TimerId id)
+    {
+      std::uint32_t idx = std::uint32_t(id);
+      if (id == 0 || idx >= nodes.size() || nodes[idx].gen != std::uint32_t(id >> 32) || nodes[idx].slot == npos)
+        return false;
+      unlink(idx);
+      release(idx);
+      return true;
+    }
+
+    /**
+     * @brief Fire every timer due at now, callbacks may arm and cancel timers
+     * @return number of fired timers
+     */
+    size_t Advance(Clock::time_point now)
+    {
+      std::uint64_t target = now <= start ? 0 : std::uint64_t((now - start) / tick);
+      size_t        fired  = 0;
+      while (current < target)
+      {
+        if (count == 0)
+        {
+          current = target;
+          break;
+        }
+
+        ++current;
+        std::uint32_t idx0 = current & (slots - 1);
+        if (idx0 == 0)
+          for (int level = 1; level < levels; ++level)
+          {
+            std::uint32_t idx = (current >> (bits * level)) & (slots - 1);
+            cascade(level * slots + idx);
+            if (idx != 0)
+              break;
+          }
+
+        while (heads[idx0] != npos)
+        {
+          std::uint32_t idx = heads[idx0];
+          unlink(idx);
+          Callback cb = std::move(nodes[idx].cb);
+          release(idx);
+          cb();
+          ++fired;
+        }
+      }
+      return fired;
+    }
+
+    size_t Size() const { return count; }
+
+  private:
+    static constexpr int           levels   = 4;
+    static constexpr int           bits     = 8;
+    static constexpr std::uint32_t slots    = 1u << bits;
+    static constexpr std::uint64_t maxTicks = (std::uint64_t(1) << (bits * levels)) - 1;
+    static constexpr std::uint32_t npos     = std::uint32_t(-1);
+
+    struct Node
+    {
+      std::uint64_t expire = 0;
+      std::uint32_t gen    = 1;
+      std::uint32_t slot   = npos;
+      std::uint32_t prev   = npos;
+      std::uint32_t next   = npos;
+      Callback      cb;
+    };
+
+    void link(std::uint32_t idx)
+    {
+      Node&         node  = nodes[idx];
+      std::uint64_t delta = node.expire - current;
+      int           level = 0;
+      while (level + 1 < levels && delta >= (std::uint64_t(1) << (bits * (level + 1))))
+        ++level;
+
+      node.slot = level * slots + ((node.expire >> (bits * level)) & (slots - 1));
+      node.prev = npos;
+      node.next = heads[node.slot];
+      if (node.next != npos)
+        nodes[node.next].prev = idx;
+      heads[node.slot] = idx;
+    }
+
+    void unlink(std::uint32_t idx)
+    {
+      Node& node = nodes[idx];
+      if (node.prev != npos)
+        nodes[node.prev].next = node.next;
+      else
+        heads[node.slot] = node.next;
+      if (node.next != npos)
+        nodes[node.next].prev = node.prev;
+      node.slot = npos;
+    }
+
+    void release(std::uint32_t idx)
+    {
+      Node& node = nodes[idx];
+      node.cb    = nullptr;
+      // Skip generation 0 so no id is ever 0
+      node.gen  = node.gen + 1 ? node.gen + 1 : 1;
+      node.next = freeList;
+      freeList  = idx;
+      --count;
+    }
+
+    void cascade(std::uint32_t slot)
+    {
+      std::uint32_t idx = heads[slot];
+      heads[slot]       = npos;
+      while (idx != npos)
+      {
+        std::uint32_t next = nodes[idx].next;
+        link(idx);
+        idx = next;
+      }
+    }
+
+    Clock::duration   tick;
+    Clock::time_point start;
+    std::uint64_t     current = 0;
+
+    std::vector<Node> nodes;
+    std::uint32_t     freeList = npos;
+    std::uint32_t     heads[levels * slots];
+    size_t            count = 0;
+  };
+
+  namespace details
+  {
+    /**
+     * @brief Batch framing is a sequence of netstrings "<length>:<bytes>,"
+     * @brief request:  url (path + query) then body for each sub-request, e.g. "8:/user/1,0:,12:/user/2?x=1,0:,"
+     * @brief response: status then body for each sub-request in the same order
+     */
+    inline bool read_netstring(std::string_view& src, std::string_view& out)
+    {
+      size_t colon = src.find(':');
+      size_t len   = 0;
+      if (colon == 0 || colon == std::string_view::npos ||
+          std::from_chars(src.data(), src.data() + colon, len).ptr != src.data() + colon)
+        return false;
+      if (src.size() < colon + 1 + len + 1 || src[colon + 1 + len] != ',')
+        return false;
+      out = src.substr(colon + 1, len);
+      src.remove_prefix(colon + 1 + len + 1);
+      return true;
+    }
+
+    inline void write_netstring(std::string& dst, std::string_view src)
+    {
+      dst += std::to_string(src.size());
+      dst += ':';
+      dst += src;
+      dst += ',';
+    }
+
+    /**
+     * @brief Epoch based reclamation of objects still visible to readers, e.g. replaced route tables
+     * @brief A reader pins its thread's slot to the global epoch, with no lock and no shared counter written,
+     * @brief an object retired at epoch e is freed once every pinned slot is past e, nested pins share the outer one
+     */
+    class epoch_domain
+    {
+      struct slot
+      {
+        static constexpr std::uint64_t idle = ~std::uint64_t(0);
+
+        std::atomic<std::uint64_t> epoch{idle};
+        // The one object the reader uses, nullptr while it may load several
+        std::atomic<const void*> object{nullptr};
+        std::atomic<bool>        used{false};
+        unsigned                   depth = 0;
+        slot*                      next  = nullptr;
+      };
+
+    public:
+      class guard
+      {
+      public:
+        explicit guard(slot* s): s(s) {}
+        guard(guard&& other) noexcept: s(std::exchange(other.s, nullptr)) {}
+        guard(const guard&)            = delete;
+        guard& operator=(const guard&) = delete;
+        ~guard()
+        {
+          if (s)
+            global().unpin(*s);
+        }
+
+        /**
+         * @brief Promise that object, loaded after pin(), is the only retirable one used until the guard is destroyed
+         * @brief A long pin then only holds back that object, not everything retired meanwhile, nested pins keep
+         * @brief holding back everything
+         */
+        template<typename T>
+        const T& protect(const T& object)
+        {
+          if (s && s->depth == 1)
+            s->object.store(&object, std::memory_order_release);
+          return object;
+        }
+
+      private:
+        slot* s;
+      };
+
+      // Never destroyed, threads may unpin during static destruction
+      static epoch_domain& global()
+      {
+        static epoch_domain* domain = new epoch_domain;
+        return *domain;
+      }
+
+      /**
+       * @brief Pointers loaded after pin() stay valid until the guard is destroyed
+       */
+      guard pin()
+      {
+        slot& s = local();
+        s.object.store(nullptr, std::memory_order_relaxed);
+        if (s.depth++ == 0)
+          // Released, a scan that sees the new epoch never sees the object of a previous pin
+          s.epoch.store(epoch.load(std::memory_order_acquire), std::memory_order_release);
+        // Pairs with the writer's swap then scan: either the writer sees this slot or this thread sees the new pointer
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        return guard(&s);
+      }
+
+      /**
+       * @brief Call after the object was unpublished, it is released here or by the last reader that could see it
+       */
+      void retire(std::shared_ptr<const void> object)
+      {
+        std::uint64_t retiredAt = epoch.fetch_add(1, std::memory_order_seq_cst);
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          retired.push_back({retiredAt, std::move(object)});
+          pending.store(retired.size(), std::memory_order_relaxed);
+          newest.store(std::max(newest.load(std::memory_order_relaxed), retiredAt), std::memory_order_relaxed);
+        }
+        reclaim();
+      }
+
+    private:
+      struct retired_object
+      {
+        std::uint64_t               epoch;
+        std::shared_ptr<const void> object;
+      };
+
+      slot& local()
+      {
+        struct owner
+        {
+          slot* s = nullptr;
+          ~owner()
+          {
+            if (s)
+              s->used.store(false, std::memory_order_release);
+          }
+        };
+        thread_local owner self;
+        if (self.s)
+          return *self.s;
+
+        // Slots of exited threads are reused, the list only grows to the peak thread count
+        for (slot* s = slots.load(std::memory_order_acquire); s; s = s->next)
+        {
+          bool expected = false;
+          if (!s->used.load(std::memory_order_relaxed) &&
+              s->used.compare_exchange_strong(expected, true, std::memory_order_acquire))
+            return *(self.s = s);
+        }
+        slot* s = new slot;
+        s->used.store(true, std::memory_order_relaxed);
+        s->next = slots.load(std::memory_order_relaxed);
+        while (!slots.compare_exchange_weak(s->next, s, std::memory_order_release, std::memory_order_relaxed))
+        {
+        }
+        return *(self.s = s);
+      }
+
+      void unpin(slot& s)
+      {
+        if (--s.depth)
+          return;
+        std::uint64_t pinnedAt = s.epoch.load(std::memory_order_relaxed);
+        s.epoch.store(slot::idle, std::memory_order_release);
+        // Only a reader pinned before the newest retire can have held anything back, later ones skip the scan
+        if (pending.load(std::memory_order_relaxed) && pinnedAt <= newest.load(std::memory_order_relaxed))
+          reclaim();
+      }
+
+      /**
+       * @brief Never waits for the lock, whoever holds it frees what has become unreachable
+       */
+      void reclaim()
+      {
+        std::vector<retired_object> expired;
+        {
+          std::unique_lock<std::mutex> lock(mtx, std::try_to_lock);
+          if (!lock.owns_lock())
+            return;
+
+          // A reader holds back what was retired after it pinned, only its protected object if it declared one
+          std::vector<std::pair<std::uint64_t, const void*>> readers;
+          for (slot* s = slots.load(std::memory_order_acquire); s; s = s->next)
+          {
+            std::uint64_t pinnedAt = s->epoch.load(std::memory_order_seq_cst);
+            if (pinnedAt != slot::idle)
+              readers.emplace_back(pinnedAt, s->object.load(std::memory_order_seq_cst));
+          }
+
+          auto live = std::partition(retired.begin(), retired.end(),
+                                     [&readers](const retired_object& r)
+                                     {
+                                       return std::any_of(readers.begin(), readers.end(),
+                                                          [&r](auto& reader)
+                                                          {
+                                                            return r.epoch >= reader.first &&
+                                                                   (!reader.second || reader.second == r.object.get());
+                                                          });
+                                     });
+          for (auto it = live; it != retired.end(); ++it)
+            expired.push_back(std::move(*it));
+          retired.erase(live, retired.end());
+          pending.store(retired.size(), std::memory_order_relaxed);
+        }
+        // Destroyed outside the lock
+      }
+
+      std::atomic<std::uint64_t> epoch{0};
+      std::atomic<slot*>         slots{nullptr};
+      std::atomic<size_t>        pending{0};
+      std::atomic<std::uint64_t> newest{0}; // epoch of the latest retire
+
+      std::mutex                  mtx;
+      std::vector<retired_object> retired;
+    };
+
+    template<typename T>
+    concept has_before = requires(T& stage, Ctx& ctx) { stage.Before(ctx); };
+
+    template<typename T>
+    concept has_after = requires(T& stage, Ctx& ctx, Ret& ret) { stage.After(ctx, ret); };
+
+    /**
+     * @brief A middleware stage is default constructible, with one or both hooks:
+     * @brief std::optional<Ret> Before(Ctx&), returning a response short-circuits the later stages and the handler
+     * @brief void After(Ctx&, Ret&), in reverse order, for every stage whose Before ran, short-circuited or not
+     * @brief One instance per request lives on the stack, so state like a start time can pass from Before to After
+     */
+    template<typename T>
+    concept middleware_stage = std::is_default_constructible_v<T> && (has_before<T> || has_after<T>);
+
+    /**
+     * @brief Stages expanded at compile time around the route's handler, calls are direct and inlinable
+     */
+    template<typename... Stages>
+    struct middleware_chain
+    {
+      template<typename Handler>
+      static Ret run(Ctx& ctx, Handler&& handler)
+      {
+        std::tuple<Stages...> stages;
+        return enter<0>(stages, ctx, handler);
+      }
+
+    private:
+      template<size_t I, typename Handler>
+      static Ret enter(std::tuple<Stages...>& stages, Ctx& ctx, Handler& handler)
+      {
+        if constexpr (I == sizeof...(Stages))
+          return handler();
+        else
+        {
+          using stage_t = std::tuple_element_t<I, std::tuple<Stages...>>;
+          stage_t& stage = std::get<I>(stages);
+
+          Ret ret = [&]() -> Ret
+          {
+            if constexpr (has_before<stage_t>)
+            {
+              static_assert(std::is_same_v<decltype(stage.Before(ctx)), std::optional<Ret>>,
+                            "middleware Before must return std::optional<Ret>");
+              if (std::optional<Ret> early = stage.Before(ctx))
+                return std::move(*early);
+            }
+            return enter<I + 1>(stages, ctx, handler);
+          }();
+
+          if constexpr (has_after<stage_t>)
+            stage.After(ctx, ret);
+          return ret;
+        }
+      }
+    };
+  } // namespace details
+
+  class Apis
+  {
+  public:
+    using Return_t = Ret;
+    using Arg0_t   = Ctx&;
+
+  private:
+    /**
+     * @brief Header-time args of a handler, into its convertor and cleaner tables
+     */
+    struct Precheck
+    {
+      const ArgConvertors::Convertor_t* convertors = nullptr;
+      const ArgConvertors::Cleaner_t*   cleaners   = nullptr;
+      const int*                        indices    = nullptr;
+      size_t                            count      = 0;
+    };
+
+    struct ApiInfo;
+
+    /**
+     * @brief Whole call plan of a route behind one type-erased entry: middleware chain, version check and handler
+     */
+    using Invoker_t = std::function<Return_t(Arg0_t, ApiInfo&)>;
+
+    struct ApiInfo
+    {
+      Invoker_t    invoker;
+      RouteOptions options;
+      Precheck     precheck;
+
+      std::shared_ptr<Restful::details::compression_state> compression;
+      std::shared_ptr<RateLimiter>                         rateLimiter;
+      // Versioned routes only, answers HEAD
+      std::shared_ptr<Restful::details::head_cache> head;
+
+      bool batch = false;
+
+      // Registered path or pattern
+      std::string path;
+    };
+
+    /**
+     * @brief Handlers of one path, indexed by Method
+     */
+    struct Route
+    {
+      std::array<std::shared_ptr<ApiInfo>, methodCount> methods;
+      // Registered without a method
+      std::shared_ptr<ApiInfo> any;
+
+      // Router generated OPTIONS and 405 responses, rebuilt when a method is added
+      ApiInfo options;
+      ApiInfo notAllowed;
+    };
+
+    /**
+     * @brief Router trie node, one per path segment
+     * @brief Variables are tried after literals, the narrower type first: uint, int, str
+     */
+    struct RouteNode
+    {
+      std::shared_ptr<Route>                                         route;
+      std::map<std::string, std::shared_ptr<RouteNode>, std::less<>> literals;
+      std::array<std::shared_ptr<RouteNode>, 3>                      vars;
+    };
+
+    /**
+     * @brief Immutable once published, an update copies the nodes it changes and shares the rest with the previous table
+     */
+    struct RouteTable: std::enable_shared_from_this<RouteTable>
+    {
+      std::shared_ptr<RouteNode> root = std::make_shared<RouteNode>();
+    };
+
+    struct Cors
+    {
+      std::vector<std::string> allowOrigins;
+
+      bool anyOrigin      = false;
+      bool wildcardOrigin = false;
+      bool echoHeaders    = false;
+
+      // Added to preflights, and to every cross-origin response
+      std::vector<std::pair<std::string, std::string>> preflightHeaders;
+      std::vector<std::pair<std::string, std::string>> headers;
+    };
+
+    struct RouteMatch
+    {
+      Route*                                         route     = nullptr;
+      size_t                                         restBegin = 0;
+      std::array<std::string_view, Ctx::maxPathVars> vars;
+      std::uint8_t                                   varCount = 0;
+    };
+
+    struct details
+    {
+      template<typename Func>
+      struct function_traits: public function_traits<decltype(&Func::operator())>
+      {
+      };
+
+      /**
+       * @brief Convert Lambda type to std::function
+       */
+      template<typename ClassType, typename ReturnType, typename... Args>
+      struct function_traits<ReturnType (ClassType::*)(Args...) const>
+      {
+        using pointer     = ReturnType (*)(Args...);
+        using function    = std::function<ReturnType(Args...)>;
+        using return_type = ReturnType;
+        using args_type   = std::tuple<Args...>;
+      };
+
+      template<typename ReturnType, typename... Args>
+      struct function_traits<ReturnType (*)(Args...)>
+      {
+        using pointer     = ReturnType (*)(Args...);
+        using function    = std::function<ReturnType(Args...)>;
+        using return_type = ReturnType;
+        using args_type   = std::tuple<Args...>;
+      };
+
+      /**
+       * @brief Check the handler signature and convert Lambda to std::function
+       */
+      template<typename Lambda>
+      static typename function_traits<Lambda>::function to_function(Lambda& callback)
+      {
+        using func_t = function_traits<Lambda>;
+        using args_t = typename func_t::args_type;
+
+        // assert return type == Return_t
+        static_assert(std::is_same<typename func_t::return_type, Return_t>::value,
+                      "callback's return type must equal to Return_t");
+
+        // assert arg0 type == Arg0_t
+        static_assert(std::is_same<typename std::tuple_element<0, args_t>::type, Arg0_t>::value,
+                      "callback's first arg type must equal to Arg0_t");
+
+        // Captureless handlers decay to a function pointer, so the std::function code is shared per signature
+        if constexpr (std::is_convertible_v<Lambda, typename func_t::pointer>)
+          return typename func_t::function(static_cast<typename func_t::pointer>(callback));
+        else
+          return typename func_t::function(callback);
+      }
+
+      /**
+       * @brief Convert every argument through the route's convertor table, on failure the converted ones are cleaned
+       * @brief Not a template, all routes share it
+       */
+      static bool convert_args(Arg0_t ctx, const ArgConvertors::Convertor_t* convertors,
+                               const ArgConvertors::Cleaner_t* cleaners, void** args, size_t count)
+      {
+        for (size_t i = 0; i < count; ++i)
+        {
+          if (!convertors[i](args[i], ctx, int(i)))
+          {
+            for (size_t j = 0; j <= i; ++j)
+              cleaners[j](args[j]);
+            return false;
+          }
+        }
+        return true;
+      }
+
+      static void clean_args(const ArgConvertors::Cleaner_t* cleaners, void** args, size_t count)
+      {
+        for (size_t i = 0; i < count; ++i)
+          cleaners[i](args[i]);
+      }
+
+      /**
+       * @brief Convert and drop the header-time args, the handler converts them again once the body is read
+       */
+      static bool precheck_args(Arg0_t ctx, const Precheck& precheck)
+      {
+        // PathParam consumes the rest of the path
+        size_t restBegin = ctx.restBegin;
+        bool   ok        = true;
+        for (size_t i = 0; ok && i < precheck.count; ++i)
+        {
+          int   idx = precheck.indices[i];
+          void* out = nullptr;
+          ok        = precheck.convertors[idx](out, ctx, idx);
+          precheck.cleaners[idx](out);
+        }
+        ctx.restBegin = restBegin;
+        return ok;
+      }
+
+      /**
+       * @brief Only the call itself depends on the handler signature and chain, so routes sharing both share the code
+       * @brief The chain runs around the version check and the handler, so a 304 or HEAD passes through it too,
+       * @brief captureless handlers are called through their function pointer, leaving the entry as the only
+       * @brief std::function call per request, a capturing handler adds its own
+       */
+      template<typename Chain, typename... Args>
+      static Invoker_t make_invoker(std::function<Return_t(Arg0_t, Args...)>&& callback,
+                                    const ArgConvertors::Convertor_t*          convertors,
+                                    const ArgConvertors::Cleaner_t*            cleaners)
+      {
+        using pointer = Return_t (*)(Arg0_t, Args...);
+        if (pointer* function = callback.template target<pointer>())
+          return make_entry<Chain, Args...>(*function, convertors, cleaners);
+        return make_entry<Chain, Args...>(std::move(callback), convertors, cleaners);
+      }
+
+      template<typename Chain, typename... Args, typename Callback>
+      static Invoker_t make_entry(Callback callback, const ArgConvertors::Convertor_t* convertors,
+                                  const ArgConvertors::Cleaner_t* cleaners)
+      {
+        return [callback = std::move(callback), convertors, cleaners](Arg0_t ctx, ApiInfo& api) -> Return_t
+        {
+          auto handler = [&]() -> Return_t
+          {
+            std::array<void*, sizeof...(Args)> args{};
+            if (!convert_args(ctx, convertors, cleaners, args.data(), args.size()))
+              return {.status = 400}; // "Require is not satisfied" -> HTTP/400 Bad Request
+
+            Return_t ret;
+            try
+            {
+              ret = [&]<size_t... I>(std::index_sequence<I...>)
+              { return callback(ctx, Args(args[I])...); }(std::index_sequence_for<Args...>());
+            }
+            catch (const Restful::details::lazy_rejected&)
+            {
+              // A Lazy param that failed to convert when the handler first read it
+              ret = {.status = 400};
+            }
+            catch (...)
+            {
+              clean_args(cleaners, args.data(), args.size());
+              throw;
+            }
+
+            clean_args(cleaners, args.data(), args.size());
+            return ret;
+          };
+          return Chain::run(ctx, [&] { return invokeHandler(ctx, api, handler); });
+        };
+      }
+
+      /**
+       * @brief Entry of a built-in route, without middleware or converted args
+       */
+      template<typename Handler>
+      static Invoker_t make_builtin(Handler handler)
+      {
+        return [handler = std::move(handler)](Arg0_t ctx, ApiInfo& api) -> Return_t
+        { return invokeHandler(ctx, api, [&] { return handler(ctx); }); };
+      }
+    };
+
+  public:
+    template<typename... Args>
+    Apis& RegisterRestful(const std::string& path, std::function<Return_t(Arg0_t, Args...)>&& callback,
+                          const RouteOptions& options = {})
+    {
+      return registerRestful(std::nullopt, path, std::move(callback), options);
+    }
+
+    template<typename... Args>
+    Apis& RegisterRestful(const std::string& path, Return_t (*callback)(Arg0_t, Args...),
+                          const RouteOptions& options = {})
+    {
+      return RegisterRestful(path, std::function<Return_t(Arg0_t, Args...)>(callback), options);
+    }
+
+    template<typename Lambda>
+    Apis& RegisterRestful(const std::string& path, Lambda callback, const RouteOptions& options = {})
+    {
+      return RegisterRestful(path, details::to_function(callback), options);
+    }
+
+    /**
+     * @brief Method-qualified route, e.g. RegisterRestful(Method::Post, "/user", callback)
+     * @brief Other methods of the path get 405, HEAD falls back to GET and OPTIONS is answered by the router
+     * @brief A route registered without a method serves every method not registered explicitly
+     */
+    template<typename... Args>
+    Apis& RegisterRestful(Method method, const std::string& path, std::function<Return_t(Arg0_t, Args...)>&& callback,
+                          const RouteOptions& options = {})
+    {
+      if (method == Method::Other)
+        throw std::logic_error("route method should be a known method");
+      return registerRestful(method, path, std::move(callback), options);
+    }
+
+    template<typename... Args>
+    Apis& RegisterRestful(Method method, const std::string& path, Return_t (*callback)(Arg0_t, Args...),
+                          const RouteOptions& options = {})
+    {
+      return RegisterRestful(method, path, std::function<Return_t(Arg0_t, Args...)>(callback), options);
+    }
+
+    template<typename Lambda>
+    Apis& RegisterRestful(Method method, const std::string& path, Lambda callback, const RouteOptions& options = {})
+    {
+      return RegisterRestful(method, path, details::to_function(callback), options);
+    }
+
+    /**
+     * @brief Register a route pattern with typed variables, e.g. RegisterRestful<"/user/{id:int}/post/{pid}">(callback)
+     * @brief Variable types: {name:uint}, {name:int}, {name} or {name:str}, a segment not matching the type is skipped
+     * @brief Handlers receive them as PathVar<T, "name">, resolved to a variable index at compile time
+     */
+    template<Restful::details::string_literal Pattern, typename... Args>
+    Apis& RegisterRestful(std::function<Return_t(Arg0_t, Args...)>&& callback, const RouteOptions& options = {})
+    {
+      return registerPattern<Pattern>(std::nullopt, std::move(callback), options);
+    }
+
+    template<Restful::details::string_literal Pattern, typename... Args>
+    Apis& RegisterRestful(Return_t (*callback)(Arg0_t, Args...), const RouteOptions& options = {})
+    {
+      return RegisterRestful<Pattern>(std::function<Return_t(Arg0_t, Args...)>(callback), options);
+    }
+
+    template<Restful::details::string_literal Pattern, typename Lambda>
+    Apis& RegisterRestful(Lambda callback, const RouteOptions& options = {})
+    {
+      return RegisterRestful<Pattern>(details::to_function(callback), options);
+    }
+
+    template<Restful::details::string_literal Pattern, typename... Args>
+    Apis& RegisterRestful(Method method, std::function<Return_t(Arg0_t, Args...)>&& callback,
+                          const RouteOptions& options = {})
+    {
+      if (method == Method::Other)
+        throw std::logic_error("route method should be a known method");
+      return registerPattern<Pattern>(method, std::move(callback), options);
+    }
+
+    template<Restful::details::string_literal Pattern, typename... Args>
+    Apis& RegisterRestful(Method method, Return_t (*callback)(Arg0_t, Args...), const RouteOptions& options = {})
+    {
+      return RegisterRestful<Pattern>(method, std::function<Return_t(Arg0_t, Args...)>(callback), options);
+    }
+
+    template<Restful::details::string_literal Pattern, typename Lambda>
+    Apis& RegisterRestful(Method method, Lambda callback, const RouteOptions& options = {})
+    {
+      return RegisterRestful<Pattern>(method, details::to_function(callback), options);
+    }
+
+    /**
+     * @brief Route behind a middleware chain, e.g. RegisterRestful<Auth, Timing>("/x", callback), see middleware_stage
+     * @brief Stages run in order before the handler and in reverse after it, also around 304, HEAD and 400 responses
+     * @brief The chain is expanded at compile time, stages are constructed on the stack of each request
+     */
+    template<Restful::details::middleware_stage... Middleware, typename Lambda>
+      requires(sizeof...(Middleware) > 0)
+    Apis& RegisterRestful(const std::string& path, Lambda callback, const RouteOptions& options = {})
+    {
+      return registerRestful<Restful::details::middleware_chain<Middleware...>>(
+          std::nullopt, path, details::to_function(callback), options);
+    }
+
+    template<Restful::details::middleware_stage... Middleware, typename Lambda>
+      requires(sizeof...(Middleware) > 0)
+    Apis& RegisterRestful(Method method, const std::string& path, Lambda callback, const RouteOptions& options = {})
+    {
+      if (method == Method::Other)
+        throw std::logic_error("route method should be a known method");
+      return registerRestful<Restful::details::middleware_chain<Middleware...>>(
+          method, path, details::to_function(callback), options);
+    }
+
+    /**
+     * @brief Route pattern behind a middleware chain, e.g. RegisterRestful<"/user/{id:int}", Auth>(callback)
+     */
+    template<Restful::details::string_literal Pattern, Restful::details::middleware_stage... Middleware,
+             typename Lambda>
+      requires(sizeof...(Middleware) > 0)
+    Apis& RegisterRestful(Lambda callback, const RouteOptions& options = {})
+    {
+      return registerPattern<Pattern, Restful::details::middleware_chain<Middleware...>>(
+          std::nullopt, details::to_function(callback), options);
+    }
+
+    template<Restful::details::string_literal Pattern, Restful::details::middleware_stage... Middleware,
+             typename Lambda>
+      requires(sizeof...(Middleware) > 0)
+    Apis& RegisterRestful(Method method, Lambda callback, const RouteOptions& options = {})
+    {
+      if (method == Method::Other)
+        throw std::logic_error("route method should be a known method");
+      return registerPattern<Pattern, Restful::details::middleware_chain<Middleware...>>(
+          method, details::to_function(callback), options);
+    }
+
+    /**
+     * @brief Enable CORS for every route, call before the first request
+     * @brief Preflights get 204 from a precomputed header block, other responses get Access-Control-Allow-Origin
+     */
+    Apis& EnableCors(const CorsOptions& options)
+    {
+      auto join = [](const std::vector<std::string>& values)
+      {
+        std::string ret;
+        for (auto& value: values)
+          ret += (ret.empty() ? "" : ", ") + value;
+        return ret;
+      };
+
+      mCors = std::make_unique<Cors>();
+      mCors->anyOrigin =
+          std::find(options.allowOrigins.begin(), options.allowOrigins.end(), "*") != options.allowOrigins.end();
+      mCors->allowOrigins   = options.allowOrigins;
+      mCors->echoHeaders    = options.allowHeaders.empty();
+      mCors->wildcardOrigin = mCors->anyOrigin && !options.allowCredentials;
+
+      if (!options.allowHeaders.empty())
+        mCors->preflightHeaders.emplace_back("Access-Control-Allow-Headers", join(options.allowHeaders));
+      mCors->preflightHeaders.emplace_back("Access-Control-Max-Age", std::to_string(options.maxAge.count()));
+      if (options.allowCredentials)
+        mCors->headers.emplace_back("Access-Control-Allow-Credentials", "true");
+      if (!options.exposeHeaders.empty())
+        mCors->headers.emplace_back("Access-Control-Expose-Headers", join(options.exposeHeaders));
+      return *this;
+    }
+
+    /**
+     * @brief Serve files under dir for every url starting with path, e.g. RegisterStatic("/assets", "./www")
+     */
+    Apis& RegisterStatic(const std::string& path, const std::string& dir, const StaticOptions& options = {})
+    {
+      if (path.size() < 2 || path[0] != '/' || path.back() == '/')
+        throw std::logic_error("static path should start with '/' and not end with '/'");
+
+      if (path.find_first_of("{}") != std::string::npos)
+        throw std::logic_error("static path should not contain path variables");
+
+      // StaticFiles negotiates its own precompressed variants
+      auto files = std::make_shared<StaticFiles>(dir, options);
+      addRoute(Method::Get, path, {
+                         .invoker = details::make_builtin([files, prefix = path.size()](Arg0_t ctx) -> Return_t
+                         { return files->Serve(ctx, ctx.GetUrlWithoutParams().substr(std::min(prefix, ctx.GetUrlWithoutParams().size()))); }),
+                         .options = {.compression = {.minSize = 0}},
+                     });
+      return *this;
+    }
+
+    /**
+     * @brief Route answering a fixed response, e.g. health checks, feature flags or version info
+     * @brief The full HTTP/1.1 response is rendered into Ret::wire once per HttpDate change and shared by every request,
+     * @brief with HEAD and 304 variants, requests needing CORS headers get the response unrendered
+     */
+    Apis& RegisterConstant(const std::string& path, Return_t ret)
+    {
+      if (path.empty() || path[0] != '/')
+        throw std::logic_error("url should start with '/'");
+      if (path.find_first_of("{}") != std::string::npos)
+        throw std::logic_error("constant path should not contain path variables");
+
+      auto constant = std::make_shared<Restful::details::constant_response>(std::move(ret));
+      addRoute(Method::Get, path, {
+                         .invoker = details::make_builtin([this, constant](Arg0_t ctx) -> Return_t
+                         {
+                           if (mCors && !ctx.GetHeader("Origin").empty())
+                             return constant->Materialize();
+                           return constant->Serve(ctx);
+                         }),
+                         .options = {.compression = {.minSize = 0}},
+                     });
+      return *this;
+    }
+
+    /**
+     * @brief Built-in batch route, the POST body lists sub-requests which are dispatched through this route table
+     * @brief Sub-requests to parallelSafe routes run concurrently, the others run one by one on the calling thread
+     * @brief The route refers to this Apis, which must outlive it and not be moved
+     */
+    Apis& RegisterBatch(const std::string& path, const BatchOptions& options = {})
+    {
+      if (path.empty() || path[0] != '/')
+        throw std::logic_error("url should start with '/'");
+      if (path.find_first_of("{}") != std::string::npos)
+        throw std::logic_error("batch path should not contain path variables");
+
+      addRoute(std::nullopt, path, {
+                         .invoker     = details::make_builtin([this, options](Arg0_t ctx) -> Return_t { return batch(ctx, options); }),
+                         .compression = std::make_shared<Restful::details::compression_state>(CompressionOptions{}),
+                         .batch       = true,
+                     });
+      return *this;
+    }
+
+    /**
+     * @brief Apply several registrations and removals as one update, e.g.
+     * @brief apis.Update([](Apis& apis) { apis.Unregister("/v1/user"); apis.RegisterRestful("/v2/user", handler); });
+     * @brief Changes are made on a copy of the route table and published with one atomic swap, requests in flight keep
+     * @brief the table they started with, which is freed once they complete, if changes throws nothing is published
+     * @brief Register* and Unregister called on their own are published one by one, updates are serialized
+     */
+    template<typename Changes>
+    Apis& Update(Changes&& changes)
+    {
+      std::lock_guard<std::recursive_mutex> lock(mUpdateMtx);
+      ++mUpdateDepth;
+      try
+      {
+        changes(*this);
+      }
+      catch (...)
+      {
+        if (--mUpdateDepth == 0)
+          mStaging.reset();
+        throw;
+      }
+      --mUpdateDepth;
+      publish();
+      return *this;
+    }
+
+    /**
+     * @brief Remove the handler registered for method, or every handler of path, path is as registered, e.g.
+     * @brief "/user/{id:int}", prefix matching falls back to the next registered prefix
+     * @return false if nothing matched
+     */
+    bool Unregister(const std::string& path, std::optional<Method> method = std::nullopt)
+    {
+      size_t                                         count = Restful::details::route_segment_count(path);
+      std::vector<Restful::details::pattern_segment> segments(count);
+      if (!Restful::details::parse_route(path, segments.data()))
+        return false;
+
+      std::lock_guard<std::recursive_mutex> lock(mUpdateMtx);
+
+      // Probe the published table first, so a miss copies nothing
+      const RouteNode* probe = mStaging ? mStaging->root.get() : mPublished->root.get();
+      for (size_t i = 0; probe && i < count; ++i)
+        probe = child(*probe, segments[i]);
+      if (!probe || !probe->route || (method && !probe->route->methods[static_cast<size_t>(*method)]))
+        return false;
+
+      // Copy the path, remembering it to prune nodes left empty
+      std::vector<std::pair<RouteNode*, const Restful::details::pattern_segment*>> parents;
+      RouteNode* node = &writable(staging().root);
+      for (size_t i = 0; i < count; ++i)
+      {
+        parents.emplace_back(node, &segments[i]);
+        node = &writable(childSlot(*node, segments[i]));
+      }
+
+      Route& route = writable(node->route);
+      if (method)
+        route.methods[static_cast<size_t>(*method)].reset();
+      else
+      {
+        route.methods = {};
+        route.any.reset();
+      }
+
+      if (route.any || std::any_of(route.methods.begin(), route.methods.end(), [](auto& api) { return api != nullptr; }))
+        buildRouterRoutes(route, route.options.path);
+      else
+      {
+        node->route.reset();
+        for (auto it = parents.rbegin(); it != parents.rend(); ++it)
+        {
+          auto& slot = childSlot(*it->first, *it->second);
+          if (slot->route || !slot->literals.empty() ||
+              std::any_of(slot->vars.begin(), slot->vars.end(), [](auto& var) { return var != nullptr; }))
+            break;
+          if (it->second->kind == Restful::details::SegmentKind::Literal)
+            it->first->literals.erase(it->first->literals.find(it->second->text));
+          else
+            slot.reset();
+        }
+      }
+      publish();
+      return true;
+    }
+
+    /**
+     * @brief Dispatch a request to its route and produce the response
+     */
+    Return_t Handle(Arg0_t ctx)
+    {
+      auto     pin = Restful::details::epoch_domain::global().pin();
+      ApiInfo* api = lookup(ctx, pin.protect(routes()));
+      if (!api)
+        return {.status = 404};
+      if (auto rejected = admit(ctx, *api))
+        return *rejected;
+      return dispatch(ctx, *api);
+    }
+
+    /**
+     * @brief Early admission check, call as soon as the request line and headers are parsed, before reading the body
+     * @brief Also converts the path, url, header and cookie params and checks their Require, Range, MaxLength and OneOf
+     * @brief tags, so a request that was always going to fail is rejected before its body is received
+     * @return a response to send instead of dispatching (429 over the rate limit, 503 when the route's queue is overloaded,
+     * @return 400 with "Connection: close" for invalid params, the unread body should be drained or the connection closed),
+     * @return std::nullopt if the request may proceed, answer "100 Continue" if ctx.ExpectsContinue() and read the body
+     */
+    std::optional<Return_t> Admit(Arg0_t ctx)
+    {
+      auto     pin = Restful::details::epoch_domain::global().pin();
+      ApiInfo* api = lookup(ctx, pin.protect(routes()));
+      if (!api)
+        return Return_t{.status = 404};
+      if (auto rejected = admit(ctx, *api))
+        return rejected;
+      if (!details::precheck_args(ctx, api->precheck))
+        return Return_t{.status = 400, .headers = {{"Connection", "close"}}};
+      return std::nullopt;
+    }
+
+    /**
+     * @brief Asynchronous entry point for an I/O loop
+     * @return the response for Inline routes, std::nullopt for Offload routes whose response is pushed to queue later
+     */
+    std::optional<Return_t> Submit(std::unique_ptr<std::decay_t<Arg0_t>> ctx, CompletionQueue& queue,
+                                   std::uint64_t token)
+    {
+      auto              pin   = Restful::details::epoch_domain::global().pin();
+      const RouteTable& table = pin.protect(routes());
+      ApiInfo*          api   = lookup(*ctx, table);
+      if (!api)
+        return Return_t{.status = 404};
+      if (auto rejected = admit(*ctx, *api))
+        return rejected;
+      if (api->options.execution == Execution::Inline)
+        return dispatch(*ctx, *api);
+
+      // The pin ends here, the task keeps the table of its route alive instead
+      GetWorkerPool().Submit(
+          [this, api, table = table.shared_from_this(), ctx = std::shared_ptr<std::decay_t<Arg0_t>>(std::move(ctx)),
+           &queue, token]
+          {
+            Return_t ret;
+            try
+            {
+              ret = dispatch(*ctx, *api);
+            }
+            catch (...)
+            {
+              ret = {.status = 500};
+            }
+            queue.Push({token, std::move(ret)});
+          },
+          api->options.priority);
+      return std::nullopt;
+    }
+
+    /**
+     * @brief Share a pool between several Apis, call before the first request, by default one is created on first use
+     */
+    Apis& UseWorkerPool(std::shared_ptr<WorkerPool> pool)
+    {
+      mWorkerPool = std::move(pool);
+      return *this;
+    }
+
+    /**
+     * @brief Pool running offloaded routes, also exposes per priority queue statistics
+     */
+    WorkerPool& GetWorkerPool()
+    {
+      std::call_once(mWorkerPoolOnce,
+                     [this]
+                     {
+                       if (!mWorkerPool)
+                         mWorkerPool = std::make_shared<WorkerPool>();
+                     });
+      return *mWorkerPool;
+    }
+
+    Return_t Test(const std::string& path, const std::string& contentBody = "", const std::string& headers = "")
+    {
+      return Test(Method::Get, path, contentBody, headers);
+    }
+
+    Return_t Test(Method method, const std::string& path, const std::string& contentBody = "",
+                  const std::string& headers = "")
+    {
+      if (path.empty() || path[0] != '/')
+        return {.status = 400};
+
+      typename std::decay<Arg0_t>::type ctx(path, contentBody, headers);
+      ctx.SetMethod(method);
+
+      auto     pin = Restful::details::epoch_domain::global().pin();
+      ApiInfo* api = lookup(ctx, pin.protect(routes()));
+      if (!api)
+      {
+        std::cout << "Not found: " << path << std::endl;
+        return {.status = 404};
+      }
+      std::cout << "url: [" << path << "] -> [" << api->path << "]  " << std::endl;
+      if (auto rejected = admit(ctx, *api))
+        return *rejected;
+      return dispatch(ctx, *api);
+    }
+
+  private:
+    template<typename Chain = Restful::details::middleware_chain<>, typename... Args>
+    Apis& registerRestful(std::optional<Method> method, const std::string& path,
+                          std::function<Return_t(Arg0_t, Args...)>&& callback, const RouteOptions& options)
+    {
+      if (path.empty() || path[0] != '/')
+        throw std::logic_error("url should start with '/'");
+      if (path.find_first_of("{}") != std::string::npos)
+        throw std::logic_error("path variables need a compile-time pattern, use RegisterRestful<\"" + path +
+                               "\">(callback)");
+
+      addRoute(method, path,
+               {
+                   .invoker     = details::make_invoker<Chain>(std::move(callback),
+                                                        ArgConvertors::convertor_table<ArgConvertors::convertor<Args>...>.data(),
+                                                        ArgConvertors::cleaner_table<typename Args::type...>.data()),
+                   .options     = options,
+                   .precheck    = {ArgConvertors::convertor_table<ArgConvertors::convertor<Args>...>.data(),
+                                   ArgConvertors::cleaner_table<typename Args::type...>.data(),
+                                   ArgConvertors::header_time_table<Args...>::indices.data(),
+                                   ArgConvertors::header_time_table<Args...>::count},
+                   .compression = std::make_shared<Restful::details::compression_state>(options.compression),
+                   .rateLimiter = options.rateLimit.rate > 0 ? std::make_shared<RateLimiter>(options.rateLimit)
+                                                             : nullptr,
+                   .head = options.version ? std::make_shared<Restful::details::head_cache>() : nullptr,
+               });
+      return *this;
+    }
+
+    template<Restful::details::string_literal Pattern, typename Chain = Restful::details::middleware_chain<>,
+             typename... Args>
+    Apis& registerPattern(std::optional<Method> method, std::function<Return_t(Arg0_t, Args...)>&& callback,
+                          const RouteOptions& options)
+    {
+      using pattern = Restful::details::route_pattern<Pattern>;
+
+      static_assert(pattern::valid, "route pattern should start with '/', variables must be whole segments like "
+                                    "{name}, {name:int}, {name:uint} or {name:str}");
+      static_assert(pattern::var_count <= Ctx::maxPathVars, "too many variables in route pattern");
+      static_assert(pattern::unique_names, "duplicate variable name in route pattern");
+
+      addRoute(method, std::string(pattern::path),
+               {
+                   .invoker     = details::make_invoker<Chain>(
+                       std::move(callback),
+                       ArgConvertors::convertor_table<typename ArgConvertors::pattern_convertor<Pattern, Args>::type...>.data(),
+                       ArgConvertors::cleaner_table<typename Args::type...>.data()),
+                   .options     = options,
+                   .precheck    = {ArgConvertors::convertor_table<typename ArgConvertors::pattern_convertor<Pattern, Args>::type...>.data(),
+                                   ArgConvertors::cleaner_table<typename Args::type...>.data(),
+                                   ArgConvertors::header_time_table<Args...>::indices.data(),
+                                   ArgConvertors::header_time_table<Args...>::count},
+                   .compression = std::make_shared<Restful::details::compression_state>(options.compression),
+                   .rateLimiter = options.rateLimit.rate > 0 ? std::make_shared<RateLimiter>(options.rateLimit)
+                                                             : nullptr,
+                   .head = options.version ? std::make_shared<Restful::details::head_cache>() : nullptr,
+               },
+               pattern::result.segments.data());
+      return *this;
+    }
+
+    /**
+     * @brief Insert or replace the route, segments defaults to path split into literals
+     */
+    void addRoute(std::optional<Method> method, const std::string& path, ApiInfo&& info,
+                  const Restful::details::pattern_segment* segments = nullptr)
+    {
+      std::vector<Restful::details::pattern_segment> literals;
+      if (!segments)
+      {
+        literals.resize(Restful::details::route_segment_count(path));
+        Restful::details::parse_route(path, literals.data());
+        segments = literals.data();
+      }
 
-#undef REST_MAKE_BASE_CONVERTOR
+      std::lock_guard<std::recursive_mutex> lock(mUpdateMtx);
 
-    template<>
-    inline void* base_convertor<std::string>(const std::string_view& src)
+      RouteNode* node = &writable(staging().root);
+      for (size_t i = 0, n = Restful::details::route_segment_count(path); i < n; ++i)
+      {
+        std::shared_ptr<RouteNode>& slot = childSlot(*node, segments[i]);
+        if (!slot)
+          slot = std::make_shared<RouteNode>();
+        node = &writable(slot);
+      }
+
+      if (!node->route)
+        node->route = std::make_shared<Route>();
+      Route& route = writable(node->route);
+
+      info.path = path;
+      // A new ApiInfo, requests in flight keep the one of their table
+      (method ? route.methods[static_cast<size_t>(*method)] : route.any) = std::make_shared<ApiInfo>(std::move(info));
+      buildRouterRoutes(route, path);
+      publish();
+    }
+
+    /**
+     * @brief Router generated OPTIONS and 405 handlers, with the precomputed Allow header of the path
+     */
+    void buildRouterRoutes(Route& route, const std::string& path)
     {
-      return src.empty() ? nullptr : new std::string(src);
+      std::string allow;
+      for (size_t i = 0; i < methodCount; ++i)
+      {
+        Method m = Method(i);
+        if (route.any || route.methods[i] || m == Method::Options || (m == Method::Head && route.methods[0]))
+          allow += (allow.empty() ? "" : ", ") + std::string(MethodName(m));
+      }
+
+      route.options = {
+          .invoker = details::make_builtin([this, allow](Arg0_t ctx) -> Return_t { return routerOptions(ctx, allow); }),
+          .path    = path,
+      };
+      route.notAllowed = {
+          .invoker = details::make_builtin([allow](Arg0_t ctx) -> Return_t
+                                           { return {.status = 405, .headers = {{"Allow", allow}}}; }),
+          .path    = path,
+      };
     }
 
-    // sp: string_view
-    template<>
-    inline void* base_convertor<std::string_view>(const std::string_view& src)
+    static const RouteNode* child(const RouteNode& node, const Restful::details::pattern_segment& segment)
     {
-      return src.empty() ? nullptr : new std::string_view(src);
+      if (segment.kind != Restful::details::SegmentKind::Literal)
+        return node.vars[static_cast<size_t>(segment.kind) - 1].get();
+      auto it = node.literals.find(segment.text);
+      return it == node.literals.end() ? nullptr : it->second.get();
     }
 
-    // ]] ******************** Base Convertor ********************
+    static std::shared_ptr<RouteNode>& childSlot(RouteNode& node, const Restful::details::pattern_segment& segment)
+    {
+      if (segment.kind != Restful::details::SegmentKind::Literal)
+        return node.vars[static_cast<size_t>(segment.kind) - 1];
+      auto it = node.literals.find(segment.text);
+      if (it == node.literals.end())
+        it = node.literals.emplace(std::string(segment.text), nullptr).first;
+      return it->second;
+    }
 
+    /**
+     * @brief Copy on first write, anything also referenced by a published or retired table is copied, what this update
+     * @brief created or already copied is only referenced by the staging table and is changed in place
+     * @brief Readers never touch the reference counts, so use_count() only changes under mUpdateMtx or drops on reclaim
+     */
     template<typename T>
-    struct convertor
+    static T& writable(std::shared_ptr<T>& ptr)
     {
-      bool operator()(void*&, Ctx&, int) { throw std::logic_error("Unsupport convetor"); }
-    };
+      if (ptr.use_count() > 1)
+        ptr = std::make_shared<T>(*ptr);
+      return *ptr;
+    }
 
-    template<typename T, typename... Args>
-    struct convertor<PathParam<T, Args...>>
+    RouteTable& staging()
     {
-      bool operator()(void*& out, Ctx& ctx, int idx)
-      {
-        if constexpr (PathParam<T, Args...>::isRequire)
-        {
-          if (!ctx.HasRestArg())
-            return false;
-          out = base_convertor<T>(ctx.GetRestArg());
+      if (!mStaging)
+        mStaging = std::make_shared<RouteTable>(*mPublished);
+      return *mStaging;
+    }
 
-          if (out == nullptr)
-            std::cout << "Require path param: " << idx << std::endl;
+    /**
+     * @brief Swap the staging table in, outside of Update, the replaced one is freed once no reader can still see it
+     */
+    void publish()
+    {
+      if (mUpdateDepth || !mStaging)
+        return;
+      std::shared_ptr<const RouteTable> old = std::exchange(mPublished, std::move(mStaging));
+      mTable.store(mPublished.get(), std::memory_order_seq_cst);
+      Restful::details::epoch_domain::global().retire(std::move(old));
+    }
 
-          return out != nullptr;
-        }
-        else // optional
-        {
-          if (!ctx.HasRestArg())
-            return true;
-          void* ptr = base_convertor<T>(ctx.GetRestArg());
-          out       = ptr ? ptr : (void*)PathParam<T, Args...>::MakeDefaultValue();
-          return true;
-        }
-      }
-    };
+    /**
+     * @brief The published table, only valid while the calling thread is pinned
+     * @brief Requests stay pinned through inline dispatch and protect the table they use, so a slow handler only
+     * @brief holds back that one table, no reference count is touched unless the request is offloaded
+     */
+    const RouteTable& routes() const
+    {
+      return *mTable.load(std::memory_order_acquire);
+    }
 
-    template<typename T, details::string_literal Key, typename... Args>
-    struct convertor<UrlParam<T, Key, Args...>>
+    /**
+     * @brief Handler for the request method: the registered one, GET for HEAD, then the route registered without a
+     * @brief method, OPTIONS is answered by the router unless registered explicitly, anything else gets 405
+     */
+    static ApiInfo* select(Route& route, Method method)
     {
-      bool operator()(void*& out, Ctx& ctx, int idx)
-      {
-        constexpr std::string_view key = Key.view();
-        if constexpr (UrlParam<T, Key, Args...>::isRequire)
-        {
-          out = base_convertor<T>(ctx.GetUrlParam(key));
+      if (method != Method::Other && route.methods[static_cast<size_t>(method)])
+        return route.methods[static_cast<size_t>(method)].get();
+      if (method == Method::Head && route.methods[static_cast<size_t>(Method::Get)])
+        return route.methods[static_cast<size_t>(Method::Get)].get();
+      if (method == Method::Options)
+        return &route.options;
+      if (route.any)
+        return route.any.get();
+      return &route.notAllowed;
+    }
 
-          if (out == nullptr)
-            std::cout << "Require url param: " << key << std::endl;
+    /**
+     * @brief Walk the trie, a full match wins, otherwise the longest registered prefix and the remaining segments
+     * @brief become PathParam, path variables are captured as views into the url
+     */
+    ApiInfo* lookup(Arg0_t ctx, const RouteTable& table)
+    {
+      std::string_view path = ctx.GetUrlWithoutParams();
+      if (path.empty() || path[0] != '/')
+        return nullptr;
 
-          return out != nullptr;
-        }
-        else // optional
-        {
-          void* ptr = base_convertor<T>(ctx.GetUrlParam(key));
-          out       = ptr ? ptr : (void*)UrlParam<T, Key, Args...>::MakeDefaultValue();
-          return true;
-        }
-      }
-    };
+      RouteMatch current, best;
+      if (!match(*table.root, path, 0, current, best))
+        current = best;
+      if (!current.route)
+        return nullptr;
 
-    template<typename T, details::string_literal Key, typename... Args>
-    struct convertor<PostParam<T, Key, Args...>>
+      ctx.adjustRestBegin(current.restBegin);
+      ctx.pathVars     = current.vars;
+      ctx.pathVarCount = current.varCount;
+      return select(*current.route, ctx.GetMethod());
+    }
+
+    /**
+     * @brief pos is the '/' in front of the next segment
+     * @return true on a full match, left in current
+     */
+    static bool match(RouteNode& node, std::string_view path, size_t pos, RouteMatch& current, RouteMatch& best)
     {
-      bool operator()(void*& out, Ctx& ctx, int idx)
+      size_t           end     = std::min(path.find('/', pos + 1), path.size());
+      std::string_view segment = path.substr(pos + 1, end - pos - 1);
+      bool             last    = end == path.size();
+
+      auto visit = [&](RouteNode& child)
       {
-        constexpr std::string_view key = Key.view();
-        if constexpr (PostParam<T, Key, Args...>::isRequire)
+        if (child.route)
         {
-          out = base_convertor<T>(ctx.GetContentParam(key));
+          current.route     = child.route.get();
+          current.restBegin = end + 1;
+          if (last)
+            return true;
+          if (!best.route || current.restBegin > best.restBegin)
+            best = current;
+        }
+        return !last && match(child, path, end, current, best);
+      };
 
-          if (out == nullptr)
-            std::cout << "Require post param: " << key << std::endl;
+      if (auto it = node.literals.find(segment); it != node.literals.end() && visit(*it->second))
+        return true;
 
-          return out != nullptr;
-        }
-        else // optional
-        {
-          void* ptr = base_convertor<T>(ctx.GetContentParam(key));
-          out       = ptr ? ptr : (void*)PostParam<T, Key, Args...>::MakeDefaultValue();
+      if (segment.empty())
+        return false;
+
+      bool digits   = segment.find_first_not_of("0123456789") == std::string_view::npos;
+      bool negative = segment.size() > 1 && segment[0] == '-' &&
+                      segment.find_first_not_of("0123456789", 1) == std::string_view::npos;
+      bool accepts[] = {digits, digits || negative, true};
+
+      for (size_t i = 0; i < node.vars.size(); ++i)
+      {
+        if (!node.vars[i] || !accepts[i])
+          continue;
+        current.vars[current.varCount++] = segment;
+        if (visit(*node.vars[i]))
           return true;
-        }
+        --current.varCount;
       }
-    };
+      return false;
+    }
 
-    template<typename T, typename... Args>
-    struct convertor<PostBody<T, Args...>>
+    /**
+     * @brief Router generated OPTIONS response, with the precomputed CORS block for a preflight
+     */
+    Return_t routerOptions(Arg0_t ctx, const std::string& allow)
     {
-      bool operator()(void*& out, Ctx& ctx, int idx)
-      {
-        if constexpr (PostBody<T, Args...>::isRequire)
-        {
-          out = base_convertor<T>(ctx.GetRawContentBody());
+      Return_t ret{.status = 204, .headers = {{"Allow", allow}}};
 
-          if (out == nullptr)
-            std::cout << "Require post body" << std::endl;
+      std::string_view requestMethod = ctx.GetHeader("Access-Control-Request-Method");
+      if (!mCors || requestMethod.empty() || !allowedOrigin(ctx.GetHeader("Origin")))
+        return ret;
 
-          return out != nullptr;
-        }
-        else // optional
-        {
-          void* ptr = base_convertor<T>(ctx.GetRawContentBody());
-          out       = ptr ? ptr : (void*)PostBody<T, Args...>::MakeDefaultValue();
-          return true;
-        }
+      ret.headers.emplace_back("Access-Control-Allow-Methods", allow);
+      if (mCors->echoHeaders)
+      {
+        if (std::string_view headers = ctx.GetHeader("Access-Control-Request-Headers"); !headers.empty())
+          ret.headers.emplace_back("Access-Control-Allow-Headers", std::string(headers));
       }
-    };
+      ret.headers.insert(ret.headers.end(), mCors->preflightHeaders.begin(), mCors->preflightHeaders.end());
+      return ret;
+    }
 
-    template<typename Result>
-    void clean(void* ptr)
+    bool allowedOrigin(std::string_view origin) const
     {
+      if (origin.empty())
+        return false;
+      return mCors->anyOrigin ||
+             std::find(mCors->allowOrigins.begin(), mCors->allowOrigins.end(), origin) != mCors->allowOrigins.end();
     }
 
-#define REST_MAKE_DEFAULT_CLEANER(type)                                                                                \
-  template<>                                                                                                           \
-  inline void clean<type>(void* ptr)                                                                                   \
-  {                                                                                                                    \
-    if (ptr)                                                                                                           \
-      delete (type*)ptr;                                                                                               \
-  }
+    void applyCors(Arg0_t ctx, Return_t& ret)
+    {
+      std::string_view origin = ctx.GetHeader("Origin");
+      if (!allowedOrigin(origin))
+        return;
 
-    REST_MAKE_DEFAULT_CLEANER(char);
-    REST_MAKE_DEFAULT_CLEANER(short);
-    REST_MAKE_DEFAULT_CLEANER(int);
-    REST_MAKE_DEFAULT_CLEANER(long);
-    REST_MAKE_DEFAULT_CLEANER(long long);
-    REST_MAKE_DEFAULT_CLEANER(unsigned char);
-    REST_MAKE_DEFAULT_CLEANER(unsigned short);
-    REST_MAKE_DEFAULT_CLEANER(unsigned int);
-    REST_MAKE_DEFAULT_CLEANER(unsigned long);
-    REST_MAKE_DEFAULT_CLEANER(unsigned long long);
-    REST_MAKE_DEFAULT_CLEANER(float);
-    REST_MAKE_DEFAULT_CLEANER(double);
-    REST_MAKE_DEFAULT_CLEANER(long double);
-    REST_MAKE_DEFAULT_CLEANER(std::string);
-    REST_MAKE_DEFAULT_CLEANER(std::string_view);
+      if (mCors->wildcardOrigin)
+        ret.headers.emplace_back("Access-Control-Allow-Origin", "*");
+      else
+      {
+        ret.headers.emplace_back("Access-Control-Allow-Origin", std::string(origin));
+        ret.headers.emplace_back("Vary", "Origin");
+      }
+      ret.headers.insert(ret.headers.end(), mCors->headers.begin(), mCors->headers.end());
+    }
 
-#undef REST_MAKE_DEFAULT_CLEANER
-  } // namespace ArgConvertors
+    std::optional<Return_t> admit(Arg0_t ctx, ApiInfo& api)
+    {
+      if (ctx.admitted)
+        return std::nullopt;
 
-  class Apis
-  {
-  public:
-    using Return_t = Ret;
-    using Arg0_t   = Ctx&;
+      if (api.rateLimiter)
+      {
+        if (std::int64_t wait = api.rateLimiter->Acquire(ctx))
+        {
+          return Return_t{
+              .status  = 429,
+              .headers = {{"Retry-After", std::to_string((wait + 999999999) / 1000000000)}},
+          };
+        }
+      }
 
-  private:
-    struct ApiInfo
-    {
-      std::function<Return_t(Arg0_t)> invoker;
-    };
+      // Only offloaded work queues, inline handlers are bounded by the I/O loop itself
+      if (api.options.execution == Execution::Offload && !GetWorkerPool().Admit(api.options.priority))
+      {
+        auto retryAfter = GetWorkerPool().GetAdmissionOptions().retryAfter.count();
+        return Return_t{
+            .status  = 503,
+            .headers = {{"Retry-After", std::to_string(retryAfter)}},
+        };
+      }
 
-    struct details
+      ctx.admitted = true;
+      if (api.options.deadline.count() > 0 && !ctx.HasDeadline())
+        ctx.SetDeadline(std::chrono::steady_clock::now() + api.options.deadline);
+      return std::nullopt;
+    }
+
+    Return_t batch(Arg0_t ctx, const BatchOptions& options)
     {
-      template<typename Func>
-      struct function_traits: public function_traits<decltype(&Func::operator())>
+      struct SubRequest
       {
+        std::string_view url;
+        std::string_view body;
+        Return_t         ret;
       };
 
-      /**
-       * @brief Convert Lambda type to std::function
-       */
-      template<typename ClassType, typename ReturnType, typename... Args>
-      struct function_traits<ReturnType (ClassType::*)(Args...) const>
+      std::vector<SubRequest> requests;
+      std::string_view        src = ctx.GetRawContentBody();
+      while (!src.empty())
       {
-        using pointer     = ReturnType (*)(Args...);
-        using function    = std::function<ReturnType(Args...)>;
-        using return_type = ReturnType;
-        using args_type   = std::tuple<Args...>;
-      };
+        SubRequest req;
+        if (!Restful::details::read_netstring(src, req.url) || !Restful::details::read_netstring(src, req.body) ||
+            req.url.empty() || req.url[0] != '/')
+          return {.status = 400};
+        if (requests.size() == options.maxRequests)
+          return {.status = 413};
+        requests.push_back(std::move(req));
+      }
 
-      template<typename Tuple, int I>
-      using get_arg_type = typename std::tuple_element<I, Tuple>::type;
+      // Sub-requests all resolve against the table pinned here, also from the workers
+      auto              pin   = Restful::details::epoch_domain::global().pin();
+      const RouteTable& table = pin.protect(routes());
 
-      template<int I, typename Callback, typename Tuple>
-      struct invoker
+      auto run = [this, &ctx, &table](SubRequest& req, ApiInfo& api)
       {
-        Return_t operator()(Callback&& cb, Arg0_t ctx, std::vector<void*>& args) { return {}; }
+        typename std::decay<Arg0_t>::type sub(std::string(req.url), std::string(req.body),
+                                              std::string(ctx.GetRawHeaders()));
+        lookup(sub, table);
+        sub.SetRemoteAddress(std::string(ctx.GetRemoteAddress()));
+        try
+        {
+          if (auto rejected = admit(sub, api))
+            req.ret = std::move(*rejected);
+          else
+            // Compression applies to the batch response as a whole
+            req.ret = invoke(sub, api);
+        }
+        catch (...)
+        {
+          req.ret = {.status = 500};
+        }
       };
 
-#define REST_ARG(i)                                                                                                    \
-  (details::get_arg_type<Tuple, i>) { args[i] }
+      WorkerPool&             pool        = GetWorkerPool();
+      size_t                  maxParallel = options.maxParallel ? options.maxParallel : pool.Size();
+      std::atomic<size_t>     running{0};
+      std::mutex              doneMtx;
+      std::condition_variable doneCv;
 
-#if REST_GCC
-      template<typename Callback, typename Tuple>
-      struct invoker<0, Callback, Tuple>
+      // Released even if the sub-request throws, notified under the lock as the waiter owns doneCv
+      struct Finished
       {
-        Return_t operator()(Callback&& cb, Arg0_t ctx, std::vector<void*>& args) { return cb(ctx); }
+        std::atomic<size_t>&     running;
+        std::mutex&              mtx;
+        std::condition_variable& cv;
+        ~Finished()
+        {
+          std::lock_guard<std::mutex> lock(mtx);
+          running.fetch_sub(1, std::memory_order_release);
+          cv.notify_all();
+        }
       };
-#define REST_INVOKER(I, ...)                                                                                           \
-  template<typename Callback, typename Tuple>                                                                          \
-  struct invoker<I, Callback, Tuple>                                                                                   \
-  {                                                                                                                    \
-    Return_t operator()(Callback&& cb, Arg0_t ctx, std::vector<void*>& args) { return cb(ctx, __VA_ARGS__); }          \
-  };
-#else
-      template<typename Sig, typename Tuple>
-      struct invoker<0, std::function<Sig>, Tuple>
+
+      // On a worker, help with queued tasks instead of blocking one, any other thread, e.g. the I/O loop running an
+      // Inline batch, only waits, so it never runs the offloaded work of other requests
+      auto waitBelow = [&pool, &running, &doneMtx, &doneCv](size_t limit)
       {
-        Return_t operator()(const std::function<Sig>& cb, Arg0_t ctx, std::vector<void*>& args) { return cb(ctx); }
+        if (pool.IsWorkerThread())
+        {
+          while (running.load(std::memory_order_acquire) > limit)
+            if (!pool.RunPendingTask())
+              std::this_thread::yield();
+          return;
+        }
+        std::unique_lock<std::mutex> lock(doneMtx);
+        doneCv.wait(lock, [&running, limit] { return running.load(std::memory_order_acquire) <= limit; });
       };
-#define REST_INVOKER(I, ...)                                                                                           \
-  template<typename Sig, typename Tuple>                                                                               \
-  struct invoker<I, std::function<Sig>, Tuple>                                                                         \
-  {                                                                                                                    \
-    Return_t operator()(const std::function<Sig>& cb, Arg0_t ctx, std::vector<void*>& args)                            \
-    {                                                                                                                  \
-      return cb(ctx, __VA_ARGS__);                                                                                     \
-    }                                                                                                                  \
-  };
-#endif
 
-      // Support up to 15 parameters
-      REST_INVOKER(1, REST_ARG(0));
-      REST_INVOKER(2, REST_ARG(0), REST_ARG(1));
-      REST_INVOKER(3, REST_ARG(0), REST_ARG(1), REST_ARG(2));
-      REST_INVOKER(4, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3));
-      REST_INVOKER(5, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4));
-      REST_INVOKER(6, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5));
-      REST_INVOKER(7, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6));
-      REST_INVOKER(8, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6),
-                   REST_ARG(7));
-      REST_INVOKER(9, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6),
-                   REST_ARG(7), REST_ARG(8));
-      REST_INVOKER(10, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6),
-                   REST_ARG(7), REST_ARG(8), REST_ARG(9));
-      REST_INVOKER(11, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6),
-                   REST_ARG(7), REST_ARG(8), REST_ARG(9), REST_ARG(10));
-      REST_INVOKER(12, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6),
-                   REST_ARG(7), REST_ARG(8), REST_ARG(9), REST_ARG(10), REST_ARG(11));
-      REST_INVOKER(13, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6),
-                   REST_ARG(7), REST_ARG(8), REST_ARG(9), REST_ARG(10), REST_ARG(11), REST_ARG(12));
-      REST_INVOKER(14, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6),
-                   REST_ARG(7), REST_ARG(8), REST_ARG(9), REST_ARG(10), REST_ARG(11), REST_ARG(12), REST_ARG(13));
-      REST_INVOKER(15, REST_ARG(0), REST_ARG(1), REST_ARG(2), REST_ARG(3), REST_ARG(4), REST_ARG(5), REST_ARG(6),
-                   REST_ARG(7), REST_ARG(8), REST_ARG(9), REST_ARG(10), REST_ARG(11), REST_ARG(12), REST_ARG(13),
-                   REST_ARG(14));
-
-#undef REST_INVOKER
-#undef REST_ARG
-
-      template<typename... Args>
-      static std::function<Return_t(Arg0_t ctx)> make_invoker(std::function<Return_t(Arg0_t, Args...)>&& callback,
-                                                              std::vector<ArgConvertors::Convertor_t>&&  convertors,
-                                                              std::vector<ArgConvertors::Cleaner_t>&&    cleaners)
-      {
-        return [callback = std::move(callback), convertors = std::move(convertors),
-                cleaners = std::move(cleaners)](Arg0_t ctx) -> Return_t
-        {
-          std::vector<void*> args;
-          args.resize(sizeof...(Args));
-          for (int i = 0; i < sizeof...(Args); ++i)
-          {
-            if (!convertors[i](args[i], ctx, i))
+      for (auto& req: requests)
+      {
+        typename std::decay<Arg0_t>::type probe(std::string(req.url), "");
+        ApiInfo*                          api = lookup(probe, table);
+        if (!api || api->batch)
+        {
+          req.ret.status = !api ? 404 : 400;
+          continue;
+        }
+        if (!api->options.parallelSafe)
+        {
+          // Acts as a barrier, so it never overlaps with any other sub-request
+          waitBelow(0);
+          run(req, *api);
+          continue;
+        }
+        waitBelow(maxParallel - 1);
+        running.fetch_add(1, std::memory_order_relaxed);
+        pool.Submit(
+            [&run, &req, &running, &doneMtx, &doneCv, api]
             {
-              for (int j = 0; j <= i; ++j)
-                cleaners[j](args[j]);
-              return {}; // "Require is not satisfied" -> HTTP/400 Bad Request
-            }
-          }
-
-#if REST_GCC
-          Return_t ret = details::invoker<sizeof...(Args), decltype(callback), std::tuple<Args...>>()(
-              std::move(callback), ctx, args);
-#else
-          Return_t ret =
-              details::invoker<sizeof...(Args), decltype(callback), std::tuple<Args...>>()(callback, ctx, args);
-#endif
-
-          for (int i = 0; i < sizeof...(Args); ++i)
-            cleaners[i](args[i]);
+              Finished finished{running, doneMtx, doneCv};
+              run(req, *api);
+            },
+            api->options.priority);
+      }
+      waitBelow(0);
 
-          return ret;
-        };
+      Return_t ret{.headers = {{"Content-Type", "application/x-restful-batch"}}};
+      for (auto& req: requests)
+      {
+        Restful::details::write_netstring(ret.body, std::to_string(req.ret.status));
+        req.ret.Flatten();
+        Restful::details::write_netstring(ret.body, req.ret.GetBody());
       }
-    };
+      return ret;
+    }
 
-  public:
-    template<typename... Args>
-    Apis& RegisterRestful(const std::string& path, std::function<Return_t(Arg0_t, Args...)>&& callback)
+    Return_t dispatch(Arg0_t ctx, ApiInfo& api)
     {
-      static_assert(sizeof...(Args) <= 15, "Arguments count must <= 15");
+      if (ctx.Expired())
+        return {.status = 504};
 
-      if (path.empty() || path[0] != '/')
-        throw std::logic_error("url should start with '/'");
+      Return_t ret = invoke(ctx, api);
+      if (api.compression)
+        api.compression->apply(ctx, ret);
 
-      mRestfulCallbackMap[path] = {
-          .invoker = details::make_invoker(std::move(callback), {ArgConvertors::convertor<Args>()...},
-                                           {ArgConvertors::clean<typename Args::type>...}),
-      };
+      // Cached before CORS, which depends on the request, a HEAD answered from the cache already has Content-Length
+      if (api.head && ret.status == 200 && !ret.etag.empty() &&
+          (ctx.GetMethod() == Method::Get || (ctx.GetMethod() == Method::Head && !ret.FindHeader("Content-Length"))))
+        api.head->store(ctx, ret);
 
-      return *this;
-    }
+      if (mCors)
+        applyCors(ctx, ret);
 
-    template<typename... Args>
-    Apis& RegisterRestful(const std::string& path, Return_t (*callback)(Arg0_t, Args...))
-    {
-      return RegisterRestful(path, std::function<Return_t(Arg0_t, Args...)>(callback));
+      // HEAD keeps the headers of GET, the body length moves to Content-Length
+      if (ctx.GetMethod() == Method::Head)
+      {
+        size_t size = ret.BodySize();
+        if (!ret.FindHeader("Content-Length") && (size || !ret.filePath.empty()))
+          ret.headers.emplace_back("Content-Length", std::to_string(ret.filePath.empty() ? size : ret.fileLength));
+        ret.ClearBody();
+        ret.filePath.clear();
+        ret.fileOffset = ret.fileLength = 0;
+      }
+      return ret;
     }
 
-    template<typename Lambda>
-    Apis& RegisterRestful(const std::string& path, Lambda callback)
-    {
-      using func_t = details::function_traits<Lambda>;
-      using args_t = typename func_t::args_type;
+    Return_t invoke(Arg0_t ctx, ApiInfo& api) { return api.invoker(ctx, api); }
 
-      // assert return type == Return_t
-      static_assert(std::is_same<typename func_t::return_type, Return_t>::value,
-                    "callback's return type must equal to Return_t");
+    /**
+     * @brief Version check, handler and validators, inside the middleware chain so a 304 or HEAD passes through it too
+     */
+    template<typename Handler>
+    static Return_t invokeHandler(Arg0_t ctx, ApiInfo& api, Handler&& handler)
+    {
+      if (!api.options.version)
+      {
+        Return_t ret = handler();
+        Restful::details::apply_validators(ctx, ret);
+        return ret;
+      }
 
-      // assert arg0 type == Arg0_t
-      static_assert(std::is_same<typename std::tuple_element<0, args_t>::type, Arg0_t>::value,
-                    "callback's first arg type must equal to Arg0_t");
+      ResourceVersion version = api.options.version(ctx);
+      std::string     etag    = Restful::details::format_etag(version.tag);
+      if (std::optional<Return_t> ret = revalidate(ctx, api, version, etag))
+        return std::move(*ret);
 
-      return RegisterRestful(path, typename func_t::function(callback));
+      Return_t ret = handler();
+      if (ret.etag.empty())
+        ret.etag = std::move(etag);
+      if (ret.lastModified == 0)
+        ret.lastModified = version.lastModified;
+      Restful::details::apply_validators(ctx, ret);
+      return ret;
     }
 
-    void Test(const std::string& path, const std::string& contentBody = "")
+    /**
+     * @brief Answer without the handler where possible: 304 for an unchanged resource, HEAD from the header block of
+     * @brief the last GET of this version, not a template so the handler specific code stays small
+     */
+    static std::optional<Return_t> revalidate(Arg0_t ctx, ApiInfo& api, const ResourceVersion& version,
+                                              const std::string& etag)
     {
-      if (path.empty() || path[0] != '/')
-        return;
-
-      typename std::decay<Arg0_t>::type ctx(path, contentBody);
+      // Cheap version check first, an unchanged resource never executes the handler
+      if (Restful::details::not_modified(ctx, etag, version.lastModified))
+      {
+        Return_t ret{.status = 304};
+        ret.headers.emplace_back("ETag", "\"" + etag + "\"");
+        if (version.lastModified > 0)
+          ret.headers.emplace_back("Last-Modified", Restful::details::format_http_date(version.lastModified));
+        return ret;
+      }
 
-      std::string _path = std::string(ctx.GetUrlWithoutParams());
-      auto        it    = mRestfulCallbackMap.find(_path);
-      size_t      pos   = path.size();
-      for (;;)
+      // HEAD gets the header block of the last GET of this version, the handler only runs on a miss
+      if (ctx.GetMethod() == Method::Head)
       {
-        if (it != mRestfulCallbackMap.end())
+        Return_t ret{.etag = etag, .lastModified = version.lastModified};
+        if (api.head->merge(ctx, ret))
         {
-          std::cout << "url: [" << path << "] -> [" << it->first << "]  " << std::endl;
-          ctx.adjustRestBegin(pos + 1);
-          it->second.invoker(ctx);
-          return;
+          Restful::details::apply_validators(ctx, ret);
+          return ret;
         }
-
-        pos = _path.rfind('/', pos - 1);
-        if (pos == 0 || pos == std::string::npos)
-          break;
-
-        it = mRestfulCallbackMap.find(_path.substr(0, pos));
       }
-      std::cout << "Not found: " << path << std::endl;
+      return std::nullopt;
     }
 
   private:
-    std::map<std::string, ApiInfo> mRestfulCallbackMap;
+    // Owned by mPublished, read through mTable by pinned readers, updates are staged in mStaging
+    std::shared_ptr<const RouteTable> mPublished = std::make_shared<RouteTable>();
+    std::atomic<const RouteTable*>    mTable{mPublished.get()};
+    std::shared_ptr<RouteTable>       mStaging;
+    std::recursive_mutex              mUpdateMtx;
+    int                               mUpdateDepth = 0;
+
+    std::unique_ptr<Cors>       mCors;
+    std::shared_ptr<WorkerPool> mWorkerPool;
+    std::once_flag              mWorkerPoolOnce;
   };
 } // namespace Restful
 